@@ -0,0 +1,293 @@
+#include "simulation.h"
+
+#ifndef PHYSBOX_PROFILING
+#error The benchmark reads phase timings from the profiler, build it with PHYSBOX_PROFILING defined
+#endif
+
+// Steps seeded scenes headless over a range of object counts and reports how
+// fast every phase of processPhysics runs. One CSV row per scene, backend and
+// object count goes to the output file, a short summary to the console.
+//
+// Benchmark [--scene uniform|system|lattice|accretion] [--backend bullet|circle]
+//           [--gravity pairwise|barnes-hut|direct] [--min N] [--max N] [--warmup STEPS] [--steps STEPS] [--seed N] [--output FILE]
+
+enum Scene {
+	SCENE_UNIFORM,
+	SCENE_SYSTEM,
+	SCENE_LATTICE,
+	SCENE_ACCRETION,
+	SCENES_NUM
+};
+
+const int OBJECT_COUNTS[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+const double BALL_RADIUS = 2;
+// World area per ball, the world grows with the object count so density stays the same
+const double UNIFORM_AREA_PER_BALL = 400;
+// Dense enough that balls keep running into each other
+const double ACCRETION_AREA_PER_BALL = 40;
+// Lattice neighbors start this fraction of springDistance apart, close enough to connect
+const double LATTICE_SPACING = 0.8;
+// Distance between neighboring moon orbits in the system scene
+const double SYSTEM_ORBIT_GAP = BALL_RADIUS * 2.5;
+const double SYSTEM_CENTER_RADIUS = 50;
+
+struct Options {
+	int scene = -1;
+	int backend = -1;
+	// Pairwise gravity is quadratic and would dominate every large run
+	GravityMode gravityMode = GRAVITY_MODE_BARNES_HUT;
+	int minCount = OBJECT_COUNTS[0];
+	int maxCount = 100000;
+	int warmupSteps = 10;
+	int steps = 100;
+	unsigned int seed = 1;
+	std::string output = "benchmark.csv";
+};
+
+const char* getSceneName(int scene) {
+	switch(scene) {
+		case SCENE_UNIFORM:		return "uniform";
+		case SCENE_SYSTEM:		return "system";
+		case SCENE_LATTICE:		return "lattice";
+		case SCENE_ACCRETION:	return "accretion";
+		default:				return "?";
+	}
+}
+
+const char* getBackendName(int backend) {
+	switch(backend) {
+		case PHYSICS_BACKEND_BULLET: return "bullet";
+		case PHYSICS_BACKEND_CIRCLE: return "circle";
+		default:					 return "?";
+	}
+}
+
+const char* getGravityModeName(int gravityMode) {
+	switch(gravityMode) {
+		case GRAVITY_MODE_PAIRWISE:		return "pairwise";
+		case GRAVITY_MODE_BARNES_HUT:	return "barnes-hut";
+		case GRAVITY_MODE_DIRECT:		return "direct";
+		default:						return "?";
+	}
+}
+
+// Mode name, with the kernel the direct mode actually runs
+std::string getGravityName(Simulation& simulation) {
+	if(!simulation.gravityRadialEnabled) return "off";
+	std::string name = getGravityModeName(simulation.gravityMode);
+	if(simulation.gravityMode == GRAVITY_MODE_DIRECT) {
+		name += std::string("-") + gravitykernel::getKernelName(simulation.gravityKernel);
+	}
+	return name;
+}
+
+bool parseOptions(int argc, char* args[], Options& options) {
+	for(int i = 1; i < argc; i++) {
+		std::string arg = args[i];
+		if(i + 1 >= argc) {
+			std::cout << "Missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = args[++i];
+		if(arg == "--scene") {
+			for(int scene = 0; scene < SCENES_NUM; scene++) {
+				if(value == getSceneName(scene)) options.scene = scene;
+			}
+			if(options.scene < 0) {
+				std::cout << "Unknown scene " << value << std::endl;
+				return false;
+			}
+		} else if(arg == "--backend") {
+			if(value == "bullet") {
+				options.backend = PHYSICS_BACKEND_BULLET;
+			} else if(value == "circle") {
+				options.backend = PHYSICS_BACKEND_CIRCLE;
+			} else {
+				std::cout << "Unknown backend " << value << std::endl;
+				return false;
+			}
+		} else if(arg == "--gravity") {
+			int gravityMode = -1;
+			for(int mode = 0; mode < GRAVITY_MODES_NUM; mode++) {
+				if(value == getGravityModeName(mode)) gravityMode = mode;
+			}
+			if(gravityMode < 0) {
+				std::cout << "Unknown gravity mode " << value << std::endl;
+				return false;
+			}
+			options.gravityMode = (GravityMode)gravityMode;
+		} else if(arg == "--min") {
+			options.minCount = atoi(value.c_str());
+		} else if(arg == "--max") {
+			options.maxCount = atoi(value.c_str());
+		} else if(arg == "--warmup") {
+			options.warmupSteps = atoi(value.c_str());
+		} else if(arg == "--steps") {
+			options.steps = atoi(value.c_str());
+		} else if(arg == "--seed") {
+			options.seed = (unsigned int)atoi(value.c_str());
+		} else if(arg == "--output") {
+			options.output = value;
+		} else {
+			std::cout << "Unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+	if(options.steps <= 0) {
+		std::cout << "--steps has to be positive" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// 16:9 world of the given area
+void setWorldArea(Simulation& simulation, double area) {
+	simulation.worldWidth = sqrt(area * 16 / 9);
+	simulation.worldHeight = area / simulation.worldWidth;
+}
+
+void addWalls(Simulation& simulation) {
+	simulation.addPlane(Plane::POS_LEFT);
+	simulation.addPlane(Plane::POS_RIGHT);
+	simulation.addPlane(Plane::POS_TOP);
+	simulation.addPlane(Plane::POS_BOTTOM);
+}
+
+BallParameters makeBall(double x, double y) {
+	BallParameters ball;
+	ball.x = x;
+	ball.y = y;
+	ball.radius = BALL_RADIUS;
+	ball.speedX = 0;
+	ball.speedY = 0;
+	ball.color = utils::randomHSVColor(100, 100);
+	ball.isActive = true;
+	return ball;
+}
+
+void addRandomBalls(Simulation& simulation, int count) {
+	std::vector<BallParameters> balls;
+	balls.reserve(count);
+	for(int i = 0; i < count; i++) {
+		double x = utils::randomBetween(0, simulation.worldWidth);
+		double y = utils::randomBetween(0, simulation.worldHeight);
+		balls.push_back(makeBall(x, y));
+	}
+	simulation.addBalls(balls);
+}
+
+void buildScene(Simulation& simulation, int scene, int count, GravityMode gravityMode) {
+	simulation.collisionsEnabled = true;
+	simulation.collisionType = COLLISION_TYPE_BOUNCE;
+	simulation.gravityRadialEnabled = true;
+	simulation.gravityMode = gravityMode;
+	simulation.gravityVerticalEnabled = false;
+	simulation.backgroundFrictionEnabled = false;
+	simulation.springsEnabled = false;
+	switch(scene) {
+		case SCENE_UNIFORM: {
+			setWorldArea(simulation, count * UNIFORM_AREA_PER_BALL);
+			simulation.resetSimulation();
+			addRandomBalls(simulation, count);
+			addWalls(simulation);
+			break;
+		}
+		case SCENE_SYSTEM: {
+			// Orbits reach far past any window, so no walls
+			simulation.resetSimulation();
+			simulation.generateSystem(0, 0, SYSTEM_CENTER_RADIUS, BALL_RADIUS, count - 1, SYSTEM_ORBIT_GAP);
+			break;
+		}
+		case SCENE_LATTICE: {
+			simulation.gravityRadialEnabled = false;
+			simulation.gravityVerticalEnabled = true;
+			simulation.springsEnabled = true;
+			double spacing = simulation.springDistance * LATTICE_SPACING;
+			int columns = (int)ceil(sqrt((double)count));
+			int rows = (count + columns - 1) / columns;
+			simulation.worldWidth = (columns + 1) * spacing;
+			simulation.worldHeight = (rows + 1) * spacing;
+			simulation.resetSimulation();
+			std::vector<BallParameters> balls;
+			balls.reserve(count);
+			for(int i = 0; i < count; i++) {
+				balls.push_back(makeBall((i % columns + 1) * spacing, (i / columns + 1) * spacing));
+			}
+			simulation.addBalls(balls);
+			addWalls(simulation);
+			break;
+		}
+		case SCENE_ACCRETION: {
+			simulation.collisionType = COLLISION_TYPE_MERGE;
+			setWorldArea(simulation, count * ACCRETION_AREA_PER_BALL);
+			simulation.resetSimulation();
+			addRandomBalls(simulation, count);
+			addWalls(simulation);
+			break;
+		}
+	}
+}
+
+int main(int argc, char* args[]) {
+
+	Options options;
+	if(!parseOptions(argc, args, options)) {
+		return 1;
+	}
+	std::ofstream csv(options.output);
+	if(!csv.is_open()) {
+		std::cout << "Could not open " << options.output << std::endl;
+		return 1;
+	}
+	csv << "scene,backend,gravity,objects,final_objects,steps,seconds,steps_per_s,"
+		<< "world_ms,gravity_ms,springs_ms,forces_ms,merges_ms,delete_ms,"
+		<< "world_steps_per_s,gravity_steps_per_s,springs_steps_per_s,merges_steps_per_s" << std::endl;
+
+	// No config file, everything not set below keeps its default
+	Simulation simulation([](Simulation* sim) {
+		return false;
+	}, "");
+	Profiler& profiler = simulation.getProfiler();
+
+	for(int scene = 0; scene < SCENES_NUM; scene++) {
+		if(options.scene >= 0 && scene != options.scene) continue;
+		for(int backend = PHYSICS_BACKEND_BULLET; backend <= PHYSICS_BACKEND_CIRCLE; backend++) {
+			if(options.backend >= 0 && backend != options.backend) continue;
+			for(int count: OBJECT_COUNTS) {
+				if(count < options.minCount || count > options.maxCount) continue;
+				simulation.physicsBackend = (PhysicsBackend)backend;
+				utils::seedRandom(options.seed);
+				buildScene(simulation, scene, count, options.gravityMode);
+				if(options.warmupSteps > 0) {
+					simulation.headlessSteps = options.warmupSteps;
+					simulation.runSimulation();
+				}
+				profiler.reset();
+				simulation.headlessSteps = options.steps;
+				double seconds = simulation.runSimulation();
+
+				double steps = (double)profiler.getFrameCount(PROFILE_GROUP_PHYSICS);
+				double gravity = profiler.getTotal(PROFILE_PHASE_GRAVITY) / steps;
+				double springs = profiler.getTotal(PROFILE_PHASE_SPRINGS) / steps;
+				double forces = profiler.getTotal(PROFILE_PHASE_APPLY_FORCES) / steps;
+				double merges = profiler.getTotal(PROFILE_PHASE_MERGES) / steps;
+				double remove = profiler.getTotal(PROFILE_PHASE_DELETE) / steps;
+				// Step includes the force passes that run in the tick callback
+				double world = profiler.getTotal(PROFILE_PHASE_STEP) / steps - gravity - springs - forces;
+				auto stepsPerSecond = [](double milliseconds) {
+					return milliseconds > 0 ? utils::toString(1000 / milliseconds, 2) : std::string();
+				};
+				csv << getSceneName(scene) << "," << getBackendName(backend) << "," << getGravityName(simulation) << "," << count << ","
+					<< simulation.objects.size() << "," << (long long)steps << "," << seconds << ","
+					<< (seconds > 0 ? steps / seconds : 0) << ","
+					<< world << "," << gravity << "," << springs << "," << forces << "," << merges << "," << remove << ","
+					<< stepsPerSecond(world) << "," << stepsPerSecond(gravity) << ","
+					<< stepsPerSecond(springs) << "," << stepsPerSecond(merges) << std::endl;
+				std::cout << getSceneName(scene) << " " << getBackendName(backend) << " " << getGravityName(simulation) << " " << count << ": "
+					<< utils::toString(seconds > 0 ? steps / seconds : 0, 1) << " steps/s" << std::endl;
+			}
+		}
+	}
+
+	return 0;
+}
\ No newline at end of file
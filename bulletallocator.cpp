@@ -0,0 +1,52 @@
+#include "bulletallocator.h"
+#include "pool.h"
+#include <cstdlib>
+#include <btBulletDynamicsCommon.h>
+
+namespace {
+
+	const size_t SIZE_CLASS_STEP = 64;
+	const int SIZE_CLASSES = 16;
+	const int BLOCKS_PER_SLAB = 256;
+	// Keeps the size class in front of each block, Bullet's free does not pass the size
+	const size_t HEADER_SIZE = 16;
+
+	// Never deleted, Bullet objects can still be freed during static destruction
+	SlabAllocator* allocators[SIZE_CLASSES];
+	bool installed = false;
+
+	void* allocateMemory(size_t size) {
+		size_t totalSize = size + HEADER_SIZE;
+		int sizeClass = (int)((totalSize - 1) / SIZE_CLASS_STEP);
+		char* block;
+		if(sizeClass < SIZE_CLASSES) {
+			block = (char*)allocators[sizeClass]->allocate();
+		} else {
+			block = (char*)std::malloc(totalSize);
+			if(!block) return nullptr;
+		}
+		*(int*)block = sizeClass;
+		return block + HEADER_SIZE;
+	}
+
+	void freeMemory(void* memory) {
+		if(!memory) return;
+		char* block = (char*)memory - HEADER_SIZE;
+		int sizeClass = *(int*)block;
+		if(sizeClass < SIZE_CLASSES) {
+			allocators[sizeClass]->free(block);
+		} else {
+			std::free(block);
+		}
+	}
+
+}
+
+void bulletallocator::install() {
+	if(installed) return;
+	for(int i = 0; i < SIZE_CLASSES; i++) {
+		allocators[i] = new SlabAllocator((i + 1) * SIZE_CLASS_STEP, BLOCKS_PER_SLAB);
+	}
+	btAlignedAllocSetCustom(allocateMemory, freeMemory);
+	installed = true;
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+// Routes Bullet's allocations through size-class slab pools, so the bodies,
+// motion states and shapes of a scene sit next to each other and freeing them
+// does not go back to the system. Bullet must only be used from one thread.
+namespace bulletallocator {
+
+	// Safe to call more than once, has to run before anything is allocated through Bullet
+	void install();
+
+}
\ No newline at end of file
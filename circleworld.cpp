@@ -0,0 +1,324 @@
+#include "circleworld.h"
+#include <algorithm>
+#include <cmath>
+
+void CircleWorld::addRigidBody(btRigidBody* body) {
+	const btCollisionShape* shape = body->getCollisionShape();
+	if(shape->getShapeType() == STATIC_PLANE_PROXYTYPE) {
+		const btStaticPlaneShape* plane = (const btStaticPlaneShape*)shape;
+		const btVector3& normal = plane->getPlaneNormal();
+		const btVector3& origin = body->getWorldTransform().getOrigin();
+		Wall wall;
+		wall.body = body;
+		wall.normalX = normal.x();
+		wall.normalY = normal.y();
+		wall.offset = plane->getPlaneConstant() + normal.x() * origin.x() + normal.y() * origin.y();
+		walls.push_back(wall);
+	} else {
+		// Circles remember their slot so removal does not have to search for them
+		body->setUserIndex((int)circles.size());
+		circles.push_back(body);
+	}
+}
+
+void CircleWorld::removeRigidBody(btRigidBody* body) {
+	if(body->getCollisionShape()->getShapeType() != STATIC_PLANE_PROXYTYPE) {
+		int circle = body->getUserIndex();
+		circles[circle] = circles.back();
+		circles[circle]->setUserIndex(circle);
+		circles.pop_back();
+		// Contacts refer to circles by index, which just changed for the moved circle
+		contacts.clear();
+		return;
+	}
+	for(int i = 0; i < (int)walls.size(); i++) {
+		if(walls[i].body == body) {
+			walls.erase(walls.begin() + i);
+			return;
+		}
+	}
+}
+
+void CircleWorld::addRigidBodies(const std::vector<btRigidBody*>& bodies) {
+	circles.reserve(circles.size() + bodies.size());
+	for(btRigidBody* body: bodies) {
+		addRigidBody(body);
+	}
+}
+
+void CircleWorld::setGravity(double x, double y) {
+	gravityX = x;
+	gravityY = y;
+}
+
+void CircleWorld::setSleepDelay(double seconds) {
+	sleepDelay = seconds;
+}
+
+int CircleWorld::stepSimulation(double timeStep, int maxSubSteps, double fixedTimeStep) {
+	// Same accumulator as btDiscreteDynamicsWorld, time beyond maxSubSteps is dropped
+	localTime += timeStep;
+	int subSteps = (int)(localTime / fixedTimeStep);
+	localTime -= subSteps * fixedTimeStep;
+	subSteps = std::min(subSteps, maxSubSteps);
+	for(int i = 0; i < subSteps; i++) {
+		internalStep(fixedTimeStep);
+	}
+	for(btRigidBody* body: circles) {
+		body->getMotionState()->setWorldTransform(body->getWorldTransform());
+	}
+	return subSteps;
+}
+
+void CircleWorld::getTouchingPairs(std::vector<BodyPair>& pairs) {
+	for(const Contact& contact: contacts) {
+		if(contact.circle2 >= 0 && contact.separation <= 0) {
+			pairs.push_back(BodyPair(circles[contact.circle1], circles[contact.circle2]));
+		}
+	}
+}
+
+void CircleWorld::internalStep(double timeStep) {
+	if(tickCallback) {
+		tickCallback(timeStep);
+	}
+	readBodies();
+	// About what gravity adds over two substeps
+	restitutionThreshold = sqrt(gravityX*gravityX + gravityY*gravityY) * timeStep * 2;
+	for(int i = 0; i < (int)circles.size(); i++) {
+		if(invMass[i] == 0) continue;
+		velX[i] += gravityX * timeStep;
+		velY[i] += gravityY * timeStep;
+	}
+	findContacts(timeStep);
+	warmStart();
+	solveContacts();
+	for(int i = 0; i < (int)circles.size(); i++) {
+		if(invMass[i] == 0) continue;
+		x[i] += velX[i] * timeStep;
+		y[i] += velY[i] * timeStep;
+	}
+	correctPositions();
+	updateSleeping(timeStep);
+	writeBodies();
+}
+
+void CircleWorld::readBodies() {
+	int count = (int)circles.size();
+	x.resize(count);
+	y.resize(count);
+	velX.resize(count);
+	velY.resize(count);
+	invMass.resize(count);
+	radius.resize(count);
+	for(int i = 0; i < count; i++) {
+		btRigidBody* body = circles[i];
+		const btVector3& position = body->getWorldTransform().getOrigin();
+		const btVector3& velocity = body->getLinearVelocity();
+		x[i] = position.x();
+		y[i] = position.y();
+		velX[i] = velocity.x();
+		velY[i] = velocity.y();
+		// Sleeping circles take part in contacts like static ones until something wakes them
+		invMass[i] = body->isActive() ? body->getInvMass() : 0;
+		radius[i] = ((const btSphereShape*)body->getCollisionShape())->getRadius();
+	}
+}
+
+void CircleWorld::writeBodies() {
+	for(int i = 0; i < (int)circles.size(); i++) {
+		if(invMass[i] == 0) continue;
+		btRigidBody* body = circles[i];
+		body->getWorldTransform().setOrigin(btVector3(x[i], y[i], 0));
+		body->setLinearVelocity(btVector3(velX[i], velY[i], 0));
+	}
+}
+
+void CircleWorld::findContacts(double timeStep) {
+	contacts.swap(previousContacts);
+	contacts.clear();
+	int count = (int)circles.size();
+	if(count == 0) return;
+	// With cells as wide as the largest diameter every touching pair is in neighboring cells
+	double maxRadius = *std::max_element(radius.begin(), radius.end());
+	grid.build(x, y, std::max(maxRadius * 2 + CONTACT_MARGIN, 1.0));
+	for(int i = 0; i < count; i++) {
+		grid.forEachNeighbor(x[i], y[i], [&](int j) {
+			if(j <= i) return;
+			if(invMass[i] == 0 && invMass[j] == 0) return;
+			double deltaX = x[j] - x[i];
+			double deltaY = y[j] - y[i];
+			double distanceSquared = deltaX*deltaX + deltaY*deltaY;
+			double radiusSum = radius[i] + radius[j];
+			double reach = radiusSum + CONTACT_MARGIN;
+			if(distanceSquared >= reach*reach) return;
+			wakeOnContact(i, j);
+			wakeOnContact(j, i);
+			double distance = sqrt(distanceSquared);
+			if(distance == 0) {
+				addContact(i, j, -1, 1, 0, -radiusSum, timeStep, circles[j]);
+			} else {
+				addContact(i, j, -1, deltaX / distance, deltaY / distance, distance - radiusSum, timeStep, circles[j]);
+			}
+		});
+		if(invMass[i] == 0) continue;
+		for(int w = 0; w < (int)walls.size(); w++) {
+			const Wall& wall = walls[w];
+			double distance = x[i] * wall.normalX + y[i] * wall.normalY - wall.offset;
+			if(distance >= radius[i] + CONTACT_MARGIN) continue;
+			// Normal points from the circle into the wall, same as for circle pairs
+			addContact(i, -1, w, -wall.normalX, -wall.normalY, distance - radius[i], timeStep, wall.body);
+		}
+	}
+}
+
+void CircleWorld::addContact(int circle1, int circle2, int wall, double normalX, double normalY, double separation,
+	double timeStep, btRigidBody* other) {
+	Contact contact;
+	contact.key = ((long long)circle1 << 32) | (circle2 >= 0 ? (unsigned)circle2 : 0x80000000u | (unsigned)wall);
+	contact.circle1 = circle1;
+	contact.circle2 = circle2;
+	contact.wall = wall;
+	contact.normalX = normalX;
+	contact.normalY = normalY;
+	contact.separation = separation;
+	btRigidBody* body = circles[circle1];
+	// Combined like btManifoldResult does it
+	double restitution = body->getRestitution() * other->getRestitution();
+	contact.friction = std::min((double)(body->getFriction() * other->getFriction()), 10.0);
+	double otherVelX = circle2 >= 0 ? velX[circle2] : 0;
+	double otherVelY = circle2 >= 0 ? velY[circle2] : 0;
+	double normalVelocity = (otherVelX - velX[circle1]) * normalX + (otherVelY - velY[circle1]) * normalY;
+	if(separation > 0) {
+		contact.targetVelocity = -separation / timeStep;
+	} else if(normalVelocity < -restitutionThreshold) {
+		contact.targetVelocity = -restitution * normalVelocity;
+	} else {
+		contact.targetVelocity = 0;
+	}
+	contact.normalImpulse = 0;
+	contact.tangentImpulse = 0;
+	contacts.push_back(contact);
+}
+
+void CircleWorld::warmStart() {
+	// Contacts of a circle come out of the grid in no particular order, sort so both lists can be merged
+	std::sort(contacts.begin(), contacts.end(), [](const Contact& a, const Contact& b) { return a.key < b.key; });
+	int previous = 0;
+	for(Contact& contact: contacts) {
+		while(previous < (int)previousContacts.size() && previousContacts[previous].key < contact.key) {
+			previous++;
+		}
+		if(previous == (int)previousContacts.size()) break;
+		if(previousContacts[previous].key != contact.key) continue;
+		// Persisting contacts start from last substep's impulses, deep stacks do not settle otherwise
+		contact.normalImpulse = previousContacts[previous].normalImpulse;
+		contact.tangentImpulse = previousContacts[previous].tangentImpulse;
+		applyImpulse(contact, contact.normalImpulse, contact.tangentImpulse);
+	}
+}
+
+void CircleWorld::solveContacts() {
+	for(int iteration = 0; iteration < SOLVER_ITERATIONS; iteration++) {
+		for(Contact& contact: contacts) {
+			int i = contact.circle1;
+			int j = contact.circle2;
+			double otherInvMass = j >= 0 ? invMass[j] : 0;
+			double massSum = invMass[i] + otherInvMass;
+			if(massSum == 0) continue;
+			double relativeVelX = (j >= 0 ? velX[j] : 0) - velX[i];
+			double relativeVelY = (j >= 0 ? velY[j] : 0) - velY[i];
+
+			double normalVelocity = relativeVelX * contact.normalX + relativeVelY * contact.normalY;
+			double oldNormalImpulse = contact.normalImpulse;
+			contact.normalImpulse = std::max(oldNormalImpulse + (contact.targetVelocity - normalVelocity) / massSum, 0.0);
+			double normalImpulse = contact.normalImpulse - oldNormalImpulse;
+
+			double tangentX = -contact.normalY;
+			double tangentY = contact.normalX;
+			double tangentVelocity = relativeVelX * tangentX + relativeVelY * tangentY;
+			double maxFriction = contact.friction * contact.normalImpulse;
+			double oldTangentImpulse = contact.tangentImpulse;
+			contact.tangentImpulse = std::min(std::max(oldTangentImpulse - tangentVelocity / massSum, -maxFriction), maxFriction);
+			double tangentImpulse = contact.tangentImpulse - oldTangentImpulse;
+
+			applyImpulse(contact, normalImpulse, tangentImpulse);
+		}
+	}
+}
+
+void CircleWorld::applyImpulse(const Contact& contact, double normalImpulse, double tangentImpulse) {
+	int i = contact.circle1;
+	int j = contact.circle2;
+	double impulseX = contact.normalX * normalImpulse - contact.normalY * tangentImpulse;
+	double impulseY = contact.normalY * normalImpulse + contact.normalX * tangentImpulse;
+	velX[i] -= impulseX * invMass[i];
+	velY[i] -= impulseY * invMass[i];
+	if(j >= 0) {
+		velX[j] += impulseX * invMass[j];
+		velY[j] += impulseY * invMass[j];
+	}
+}
+
+void CircleWorld::wakeOnContact(int circle, int other) {
+	if(invMass[circle] != 0 || invMass[other] == 0) return;
+	btRigidBody* body = circles[circle];
+	if(body->isActive() || body->getInvMass() == 0) return;
+	// Anything resting on a sleeping circle picks up about restitutionThreshold from gravity
+	// every substep, only a neighbor faster than that and the threshold wakes it
+	double threshold = body->getLinearSleepingThreshold() + restitutionThreshold;
+	if(velX[other]*velX[other] + velY[other]*velY[other] < threshold*threshold) return;
+	body->activate();
+	invMass[circle] = body->getInvMass();
+}
+
+void CircleWorld::updateSleeping(double timeStep) {
+	for(int i = 0; i < (int)circles.size(); i++) {
+		if(invMass[i] == 0) continue;
+		btRigidBody* body = circles[i];
+		if(body->getActivationState() == DISABLE_DEACTIVATION) continue;
+		double threshold = body->getLinearSleepingThreshold();
+		if(velX[i]*velX[i] + velY[i]*velY[i] >= threshold*threshold) {
+			body->setDeactivationTime(0);
+			continue;
+		}
+		body->setDeactivationTime(body->getDeactivationTime() + timeStep);
+		if(body->getDeactivationTime() < sleepDelay) continue;
+		// Written back with the others, the next substep already reads it as sleeping
+		velX[i] = 0;
+		velY[i] = 0;
+		body->setActivationState(ISLAND_SLEEPING);
+	}
+}
+
+void CircleWorld::correctPositions() {
+	for(int iteration = 0; iteration < POSITION_ITERATIONS; iteration++) {
+		correctPositionsOnce();
+	}
+}
+
+void CircleWorld::correctPositionsOnce() {
+	for(const Contact& contact: contacts) {
+		int i = contact.circle1;
+		int j = contact.circle2;
+		double otherInvMass = j >= 0 ? invMass[j] : 0;
+		double massSum = invMass[i] + otherInvMass;
+		if(massSum == 0) continue;
+		// Penetration along the contact normal after this substep's motion
+		double penetration;
+		if(j >= 0) {
+			double separation = (x[j] - x[i]) * contact.normalX + (y[j] - y[i]) * contact.normalY;
+			penetration = radius[i] + radius[j] - separation;
+		} else {
+			const Wall& wall = walls[contact.wall];
+			penetration = radius[i] - (x[i] * wall.normalX + y[i] * wall.normalY - wall.offset);
+		}
+		double correction = std::max(penetration - PENETRATION_SLOP, 0.0) * POSITION_CORRECTION / massSum;
+		x[i] -= contact.normalX * correction * invMass[i];
+		y[i] -= contact.normalY * correction * invMass[i];
+		if(j >= 0) {
+			x[j] += contact.normalX * correction * invMass[j];
+			y[j] += contact.normalY * correction * invMass[j];
+		}
+	}
+}
\ No newline at end of file
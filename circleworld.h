@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include "physicsworld.h"
+#include "spatialgrid.h"
+
+// Native 2D backend for scenes of circles between axis-aligned walls.
+// Spheres are treated as circles in the z = 0 plane and static plane shapes as
+// walls. Contacts come from a uniform grid and are resolved by a sequential
+// impulse solver with Bullet's restitution and friction combining rules.
+// Friction acts on linear velocity only, circles do not spin.
+// Circles allowed to sleep do so one by one rather than in islands, a sleeping
+// circle acts as static until something hits it faster than its threshold.
+class CircleWorld: public PhysicsWorld {
+
+public:
+	void addRigidBody(btRigidBody* body);
+	void removeRigidBody(btRigidBody* body);
+	void addRigidBodies(const std::vector<btRigidBody*>& bodies);
+	void setGravity(double x, double y);
+	void setSleepDelay(double seconds);
+	int stepSimulation(double timeStep, int maxSubSteps, double fixedTimeStep = 1.0/60.0);
+	void getTouchingPairs(std::vector<BodyPair>& pairs);
+
+private:
+	static const int SOLVER_ITERATIONS = 10;
+	static const int POSITION_ITERATIONS = 4;
+	// Penetration left alone to keep resting contacts from jittering
+	static constexpr double PENETRATION_SLOP = 0.01;
+	// Circles this close already get a contact that only lets them close the gap within
+	// one substep, which keeps stacks from bouncing in and out of contact
+	static constexpr double CONTACT_MARGIN = 0.5;
+	// Fraction of the remaining penetration removed by every position iteration
+	static constexpr double POSITION_CORRECTION = 0.8;
+	struct Wall {
+		btRigidBody* body;
+		double normalX, normalY;
+		double offset;
+	};
+	struct Contact {
+		// Identifies the same contact between substeps
+		long long key;
+		int circle1;
+		// Index of the second circle, or -1 for a wall contact
+		int circle2;
+		int wall;
+		double normalX, normalY;
+		// Gap between the surfaces when the contact was found, negative if they overlap
+		double separation;
+		// Normal velocity the solver aims for
+		double targetVelocity;
+		double friction;
+		double normalImpulse;
+		double tangentImpulse;
+	};
+	std::vector<btRigidBody*> circles;
+	std::vector<Wall> walls;
+	double gravityX = 0;
+	double gravityY = 0;
+	double localTime = 0;
+	double sleepDelay = 2.0;
+	// Approach speed below which contacts do not bounce, so resting balls stay put
+	double restitutionThreshold = 0;
+	std::vector<double> x, y;
+	std::vector<double> velX, velY;
+	std::vector<double> invMass;
+	std::vector<double> radius;
+	std::vector<Contact> contacts;
+	std::vector<Contact> previousContacts;
+	SpatialGrid grid;
+
+	void internalStep(double timeStep);
+	void readBodies();
+	void writeBodies();
+	void findContacts(double timeStep);
+	void addContact(int circle1, int circle2, int wall, double normalX, double normalY, double separation,
+		double timeStep, btRigidBody* other);
+	void warmStart();
+	void solveContacts();
+	void applyImpulse(const Contact& contact, double normalImpulse, double tangentImpulse);
+	void wakeOnContact(int circle, int other);
+	void updateSleeping(double timeStep);
+	void correctPositions();
+	void correctPositionsOnce();
+
+};
\ No newline at end of file
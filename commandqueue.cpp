@@ -0,0 +1,35 @@
+#include "commandqueue.h"
+
+void CommandQueue::push(std::function<void()> command) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(std::move(command));
+	}
+	changed.notify_one();
+}
+
+void CommandQueue::runAll() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running.swap(pending);
+	}
+	// Run outside the lock so commands can push more commands
+	for(std::function<void()>& command: running) {
+		command();
+	}
+	running.clear();
+}
+
+void CommandQueue::wait(std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait_for(lock, timeout, [this] { return !pending.empty() || woken; });
+	woken = false;
+}
+
+void CommandQueue::wake() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		woken = true;
+	}
+	changed.notify_one();
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Closures passed from one thread to another and run there in the order they were pushed
+class CommandQueue {
+
+public:
+	void push(std::function<void()> command);
+	// Runs everything pushed so far on the calling thread
+	void runAll();
+	// Returns when a command is pushed, wake() is called or the timeout passes
+	void wait(std::chrono::milliseconds timeout);
+	void wake();
+
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<std::function<void()>> pending;
+	std::vector<std::function<void()>> running;
+	bool woken = false;
+
+};
\ No newline at end of file
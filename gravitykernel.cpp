@@ -0,0 +1,160 @@
+#include "gravitykernel.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GRAVITY_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 code inside functions marked for it, MSVC accepts the intrinsics anywhere
+#if defined(GRAVITY_KERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace gravitykernel {
+
+	static void accumulateScalar(const double* x, const double* y, const double* mass, int count,
+		int target, double& accX, double& accY) {
+		for(int j = 0; j < count; j++) {
+			double deltaX = x[j] - x[target];
+			double deltaY = y[j] - y[target];
+			double distanceSquared = deltaX*deltaX + deltaY*deltaY;
+			if(distanceSquared == 0) continue;
+			double acc = mass[j] / (distanceSquared * sqrt(distanceSquared));
+			accX += deltaX * acc;
+			accY += deltaY * acc;
+		}
+	}
+
+#ifdef GRAVITY_KERNEL_X86
+
+	TARGET_SSE2 static void accumulateSSE2(const double* x, const double* y, const double* mass, int count,
+		int target, double& accX, double& accY) {
+		__m128d targetX = _mm_set1_pd(x[target]);
+		__m128d targetY = _mm_set1_pd(y[target]);
+		__m128d zero = _mm_setzero_pd();
+		__m128d sumX = zero;
+		__m128d sumY = zero;
+		int j = 0;
+		for(; j + 2 <= count; j += 2) {
+			__m128d deltaX = _mm_sub_pd(_mm_loadu_pd(x + j), targetX);
+			__m128d deltaY = _mm_sub_pd(_mm_loadu_pd(y + j), targetY);
+			__m128d distanceSquared = _mm_add_pd(_mm_mul_pd(deltaX, deltaX), _mm_mul_pd(deltaY, deltaY));
+			__m128d acc = _mm_div_pd(_mm_loadu_pd(mass + j), _mm_mul_pd(distanceSquared, _mm_sqrt_pd(distanceSquared)));
+			acc = _mm_andnot_pd(_mm_cmpeq_pd(distanceSquared, zero), acc);
+			sumX = _mm_add_pd(sumX, _mm_mul_pd(deltaX, acc));
+			sumY = _mm_add_pd(sumY, _mm_mul_pd(deltaY, acc));
+		}
+		double lanesX[2], lanesY[2];
+		_mm_storeu_pd(lanesX, sumX);
+		_mm_storeu_pd(lanesY, sumY);
+		accX += lanesX[0] + lanesX[1];
+		accY += lanesY[0] + lanesY[1];
+		for(; j < count; j++) {
+			double deltaX = x[j] - x[target];
+			double deltaY = y[j] - y[target];
+			double distanceSquared = deltaX*deltaX + deltaY*deltaY;
+			if(distanceSquared == 0) continue;
+			double acc = mass[j] / (distanceSquared * sqrt(distanceSquared));
+			accX += deltaX * acc;
+			accY += deltaY * acc;
+		}
+	}
+
+	TARGET_AVX2 static void accumulateAVX2(const double* x, const double* y, const double* mass, int count,
+		int target, double& accX, double& accY) {
+		__m256d targetX = _mm256_set1_pd(x[target]);
+		__m256d targetY = _mm256_set1_pd(y[target]);
+		__m256d zero = _mm256_setzero_pd();
+		__m256d sumX = zero;
+		__m256d sumY = zero;
+		int j = 0;
+		for(; j + 4 <= count; j += 4) {
+			__m256d deltaX = _mm256_sub_pd(_mm256_loadu_pd(x + j), targetX);
+			__m256d deltaY = _mm256_sub_pd(_mm256_loadu_pd(y + j), targetY);
+			__m256d distanceSquared = _mm256_fmadd_pd(deltaY, deltaY, _mm256_mul_pd(deltaX, deltaX));
+			__m256d acc = _mm256_div_pd(_mm256_loadu_pd(mass + j), _mm256_mul_pd(distanceSquared, _mm256_sqrt_pd(distanceSquared)));
+			acc = _mm256_andnot_pd(_mm256_cmp_pd(distanceSquared, zero, _CMP_EQ_OQ), acc);
+			sumX = _mm256_fmadd_pd(deltaX, acc, sumX);
+			sumY = _mm256_fmadd_pd(deltaY, acc, sumY);
+		}
+		double lanesX[4], lanesY[4];
+		_mm256_storeu_pd(lanesX, sumX);
+		_mm256_storeu_pd(lanesY, sumY);
+		accX += (lanesX[0] + lanesX[1]) + (lanesX[2] + lanesX[3]);
+		accY += (lanesY[0] + lanesY[1]) + (lanesY[2] + lanesY[3]);
+		for(; j < count; j++) {
+			double deltaX = x[j] - x[target];
+			double deltaY = y[j] - y[target];
+			double distanceSquared = deltaX*deltaX + deltaY*deltaY;
+			if(distanceSquared == 0) continue;
+			double acc = mass[j] / (distanceSquared * sqrt(distanceSquared));
+			accX += deltaX * acc;
+			accY += deltaY * acc;
+		}
+	}
+
+#endif
+
+	KernelType detectBestKernel() {
+#ifdef GRAVITY_KERNEL_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx2 = false;
+		if(maxLeaf >= 7) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+		// The OS has to save the YMM registers on context switches as well
+		bool osAvx = osxsave && (_xgetbv(0) & 6) == 6;
+		if(avx2 && fma && osAvx) return KERNEL_AVX2;
+		if(sse2) return KERNEL_SSE2;
+#else
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return KERNEL_AVX2;
+		if(__builtin_cpu_supports("sse2")) return KERNEL_SSE2;
+#endif
+#endif
+		return KERNEL_SCALAR;
+	}
+
+	const char* getKernelName(KernelType type) {
+		switch(type) {
+			case KERNEL_SCALAR: return "scalar";
+			case KERNEL_SSE2:	return "sse2";
+			case KERNEL_AVX2:	return "avx2";
+			default:			return "?";
+		}
+	}
+
+	void accumulateForces(KernelType type, const double* x, const double* y, const double* mass, int count,
+		int begin, int end, double gravityRadialForce, double* forceX, double* forceY) {
+		for(int i = begin; i < end; i++) {
+			double accX = 0;
+			double accY = 0;
+			switch(type) {
+#ifdef GRAVITY_KERNEL_X86
+				case KERNEL_AVX2:	accumulateAVX2(x, y, mass, count, i, accX, accY);	break;
+				case KERNEL_SSE2:	accumulateSSE2(x, y, mass, count, i, accX, accY);	break;
+#endif
+				default:			accumulateScalar(x, y, mass, count, i, accX, accY);	break;
+			}
+			forceX[i] += accX * gravityRadialForce * mass[i];
+			forceY[i] += accY * gravityRadialForce * mass[i];
+		}
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+// Exact direct-sum radial gravity over packed arrays, with SSE2 and AVX2
+// versions picked at runtime and a scalar fallback for other CPUs.
+namespace gravitykernel {
+
+	enum KernelType {
+		KERNEL_SCALAR,
+		KERNEL_SSE2,
+		KERNEL_AVX2
+	};
+
+	KernelType detectBestKernel();
+	const char* getKernelName(KernelType type);
+	// For every target i in [begin, end) adds the pull of all count bodies,
+	// gravityRadialForce * mass[i] * mass[j] / distance^2, to forceX[i] and forceY[i].
+	// Bodies at zero distance from the target, including itself, are skipped.
+	void accumulateForces(KernelType type, const double* x, const double* y, const double* mass, int count,
+		int begin, int end, double gravityRadialForce, double* forceX, double* forceY);
+
+}
\ No newline at end of file
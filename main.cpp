@@ -5,27 +5,38 @@ int main(int argc, char* args[]) {
 	Simulation simulation([](Simulation* sim) {
 		return false;
 	});
+	if(simulation.replay) {
+		simulation.runSimulation();
+		return 0;
+	}
 	libconfig::Config cfg;
 	cfg.readFile("startup.cfg");
 	int numberOfObjects = cfg.lookup("numberOfObjects");
 	double radius = cfg.lookup("radius");
+	// Starts from a saved world instead of a random one when set
+	std::string snapshot;
+	cfg.lookupValue("snapshot", snapshot);
 	while(true) {
 		simulation.resetSimulation();
-		for(int i = 0; i < numberOfObjects; i++) {
-			simulation.addBall(
-								utils::randomBetween(0, mainWindow.getSize().x),
-								utils::randomBetween(0, mainWindow.getSize().y),
-								radius,
-								utils::randomBetween(0, 0),
-								utils::randomBetween(0, 0),
-								utils::randomHSVColor(100, 100)
-							  );
+		if(snapshot.empty() || !simulation.loadSnapshot(snapshot)) {
+			std::vector<BallParameters> balls(numberOfObjects);
+			for(BallParameters& ball: balls) {
+				ball.x = utils::randomBetween(0, simulation.worldWidth);
+				ball.y = utils::randomBetween(0, simulation.worldHeight);
+				ball.radius = radius;
+				ball.speedX = 0;
+				ball.speedY = 0;
+				ball.color = utils::randomHSVColor(100, 100);
+				ball.isActive = true;
+			}
+			simulation.addBalls(balls);
+			simulation.addPlane(Plane::POS_LEFT);
+			simulation.addPlane(Plane::POS_RIGHT);
+			simulation.addPlane(Plane::POS_TOP);
+			simulation.addPlane(Plane::POS_BOTTOM);
 		}
-		simulation.addPlane(Plane::POS_LEFT);
-		simulation.addPlane(Plane::POS_RIGHT);
-		simulation.addPlane(Plane::POS_TOP);
-		simulation.addPlane(Plane::POS_BOTTOM);
 		simulation.runSimulation();
+		if(simulation.headless) break;
 	}
 
 	return 0;
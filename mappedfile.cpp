@@ -0,0 +1,71 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+	// The view keeps the file mapped on its own, so handles are closed right away
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(!mapping) return false;
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(!view) return false;
+	size = (size_t)fileSize.QuadPart;
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if(file == -1) return false;
+	struct stat status;
+	if(fstat(file, &status) == -1 || status.st_size == 0) {
+		::close(file);
+		return false;
+	}
+	void* view = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if(view == MAP_FAILED) return false;
+	madvise(view, status.st_size, MADV_SEQUENTIAL);
+	size = (size_t)status.st_size;
+#endif
+	data = (const char*)view;
+	return true;
+}
+
+void MappedFile::close() {
+	if(!data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+const char* MappedFile::getData() {
+	return data;
+}
+
+size_t MappedFile::getSize() {
+	return size;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory
+class MappedFile {
+
+public:
+	~MappedFile();
+	bool open(const std::string& path);
+	void close();
+	const char* getData();
+	size_t getSize();
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+
+};
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "material.h"
+#include "simobject.h"
+
+Material::Material(double restitution, double friction) {
+	this->restitution = restitution;
+	this->friction = friction;
+}
+
+double Material::getRestitution() {
+	return restitution;
+}
+
+double Material::getFriction() {
+	return friction;
+}
+
+void Material::setRestitution(double restitution) {
+	this->restitution = restitution;
+	for(SimObject* user: users) {
+		user->applyMaterial();
+	}
+}
+
+void Material::setFriction(double friction) {
+	this->friction = friction;
+	for(SimObject* user: users) {
+		user->applyMaterial();
+	}
+}
+
+void Material::addUser(SimObject* object) {
+	object->materialSlot = (int)users.size();
+	users.push_back(object);
+}
+
+void Material::removeUser(SimObject* object) {
+	int slot = object->materialSlot;
+	users[slot] = users.back();
+	users[slot]->materialSlot = slot;
+	users.pop_back();
+	object->materialSlot = -1;
+}
\ No newline at end of file
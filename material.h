@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+class SimObject;
+
+// Restitution and friction shared by a group of objects. A change is pushed to
+// the bodies using the material right away, so nothing is reapplied per frame.
+class Material {
+
+public:
+	Material(double restitution = 0, double friction = 0);
+	double getRestitution();
+	double getFriction();
+	void setRestitution(double restitution);
+	void setFriction(double friction);
+	void addUser(SimObject* object);
+	void removeUser(SimObject* object);
+
+private:
+	double restitution;
+	double friction;
+	std::vector<SimObject*> users;
+
+};
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "particlestore.h"
+
+int ParticleStore::add(double x, double y, double velX, double velY, double invMass, double radius, sf::Color color) {
+	this->x.push_back(x);
+	this->y.push_back(y);
+	this->velX.push_back(velX);
+	this->velY.push_back(velY);
+	forceX.push_back(0);
+	forceY.push_back(0);
+	this->invMass.push_back(invMass);
+	this->radius.push_back(radius);
+	this->color.push_back(color);
+	awake.push_back(1);
+	pendingVelX.push_back(0);
+	pendingVelY.push_back(0);
+	restForceX.push_back(0);
+	restForceY.push_back(0);
+	gravityX.push_back(0);
+	gravityY.push_back(0);
+	return size() - 1;
+}
+
+void ParticleStore::move(int from, int to) {
+	x[to] = x[from];
+	y[to] = y[from];
+	velX[to] = velX[from];
+	velY[to] = velY[from];
+	forceX[to] = forceX[from];
+	forceY[to] = forceY[from];
+	invMass[to] = invMass[from];
+	radius[to] = radius[from];
+	color[to] = color[from];
+	awake[to] = awake[from];
+	pendingVelX[to] = pendingVelX[from];
+	pendingVelY[to] = pendingVelY[from];
+	restForceX[to] = restForceX[from];
+	restForceY[to] = restForceY[from];
+	gravityX[to] = gravityX[from];
+	gravityY[to] = gravityY[from];
+}
+
+void ParticleStore::resize(int size) {
+	x.resize(size);
+	y.resize(size);
+	velX.resize(size);
+	velY.resize(size);
+	forceX.resize(size);
+	forceY.resize(size);
+	invMass.resize(size);
+	radius.resize(size);
+	color.resize(size);
+	awake.resize(size, 1);
+	pendingVelX.resize(size);
+	pendingVelY.resize(size);
+	restForceX.resize(size);
+	restForceY.resize(size);
+	gravityX.resize(size);
+	gravityY.resize(size);
+}
+
+void ParticleStore::reserve(int size) {
+	x.reserve(size);
+	y.reserve(size);
+	velX.reserve(size);
+	velY.reserve(size);
+	forceX.reserve(size);
+	forceY.reserve(size);
+	invMass.reserve(size);
+	radius.reserve(size);
+	color.reserve(size);
+	awake.reserve(size);
+	pendingVelX.reserve(size);
+	pendingVelY.reserve(size);
+	restForceX.reserve(size);
+	restForceY.reserve(size);
+	gravityX.reserve(size);
+	gravityY.reserve(size);
+}
+
+void ParticleStore::clear() {
+	x.clear();
+	y.clear();
+	velX.clear();
+	velY.clear();
+	forceX.clear();
+	forceY.clear();
+	invMass.clear();
+	radius.clear();
+	color.clear();
+	awake.clear();
+	pendingVelX.clear();
+	pendingVelY.clear();
+	restForceX.clear();
+	restForceY.clear();
+	gravityX.clear();
+	gravityY.clear();
+}
+
+int ParticleStore::size() {
+	return (int)x.size();
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+// Flat per-ball state. Entry i belongs to Simulation::objects[i]; positions and
+// velocities are mirrored from Bullet once per step, radius and color live only here.
+class ParticleStore {
+
+public:
+	std::vector<double> x, y;
+	std::vector<double> velX, velY;
+	// Forces accumulated by the force pass, turned into velocity and cleared in one reduction
+	std::vector<double> forceX, forceY;
+	std::vector<double> invMass;
+	std::vector<double> radius;
+	std::vector<sf::Color> color;
+	// Mirrored from the body, sleeping entries are skipped by the force pass until something wakes them
+	std::vector<unsigned char> awake;
+	// Velocity change held back from a sleeping entry, it wakes once this gets large enough
+	std::vector<double> pendingVelX, pendingVelY;
+	// Force of the entry's last awake substep, the load it sleeps under
+	std::vector<double> restForceX, restForceY;
+	// Last radial gravity on the entry, sleeping entries reuse it between evaluations
+	std::vector<double> gravityX, gravityY;
+
+	int add(double x, double y, double velX, double velY, double invMass, double radius, sf::Color color);
+	// Copies entry from over entry to, removal compacts the store with this and shrinks it once
+	void move(int from, int to);
+	void resize(int size);
+	void reserve(int size);
+	void clear();
+	int size();
+
+};
\ No newline at end of file
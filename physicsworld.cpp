@@ -0,0 +1,92 @@
+#include "physicsworld.h"
+
+void PhysicsWorld::addRigidBodies(const std::vector<btRigidBody*>& bodies) {
+	for(btRigidBody* body: bodies) {
+		addRigidBody(body);
+	}
+}
+
+void PhysicsWorld::setTickCallback(std::function<void(double)> callback) {
+	tickCallback = callback;
+}
+
+BulletWorld::BulletWorld() {
+	broadphase = new btDbvtBroadphase();
+	collisionConfiguration = new btDefaultCollisionConfiguration();
+	dispatcher = new btCollisionDispatcher(collisionConfiguration);
+	solver = new btSequentialImpulseConstraintSolver();
+	dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+	dynamicsWorld->setInternalTickCallback(internalTickCallback, this, true);
+}
+
+BulletWorld::~BulletWorld() {
+	delete dynamicsWorld;
+	delete solver;
+	delete dispatcher;
+	delete collisionConfiguration;
+	delete broadphase;
+}
+
+void BulletWorld::addRigidBody(btRigidBody* body) {
+	dynamicsWorld->addRigidBody(body);
+}
+
+void BulletWorld::removeRigidBody(btRigidBody* body) {
+	dynamicsWorld->removeRigidBody(body);
+}
+
+void BulletWorld::addRigidBodies(const std::vector<btRigidBody*>& bodies) {
+	// One by one every new proxy queries both trees for overlaps. Deferred, the next
+	// step finds all pairs in a single tree against tree pass instead.
+	broadphase->m_deferedcollide = true;
+	btCollisionObjectArray& collisionObjects = dynamicsWorld->getCollisionObjectArray();
+	collisionObjects.reserve(collisionObjects.size() + (int)bodies.size());
+	for(btRigidBody* body: bodies) {
+		dynamicsWorld->addRigidBody(body);
+	}
+	// Leaf by leaf insertion leaves the trees unbalanced, rebuild them once for the whole batch
+	broadphase->optimize();
+	batchPending = true;
+}
+
+void BulletWorld::setGravity(double x, double y) {
+	dynamicsWorld->setGravity(btVector3(x, y, 0));
+}
+
+void BulletWorld::setSleepDelay(double seconds) {
+	// Bullet keeps this one for all worlds
+	gDeactivationTime = seconds;
+}
+
+int BulletWorld::stepSimulation(double timeStep, int maxSubSteps, double fixedTimeStep) {
+	int subSteps = dynamicsWorld->stepSimulation(timeStep, maxSubSteps, fixedTimeStep);
+	// Bodies that never move would not be queried again, so only go back to
+	// immediate pair finding once a step has collided the whole batch
+	if(batchPending && subSteps > 0) {
+		broadphase->m_deferedcollide = false;
+		batchPending = false;
+	}
+	return subSteps;
+}
+
+void BulletWorld::getTouchingPairs(std::vector<BodyPair>& pairs) {
+	// Only pairs the broadphase let through have manifolds, and a manifold keeps
+	// points a little past contact, so check the distance of each point
+	int manifoldCount = dispatcher->getNumManifolds();
+	for(int i = 0; i < manifoldCount; i++) {
+		const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+		for(int j = 0; j < manifold->getNumContacts(); j++) {
+			if(manifold->getContactPoint(j).getDistance() <= 0) {
+				pairs.push_back(BodyPair(manifold->getBody0(), manifold->getBody1()));
+				break;
+			}
+		}
+	}
+}
+
+void BulletWorld::internalTickCallback(btDynamicsWorld* world, btScalar timeStep) {
+	BulletWorld* bulletWorld = (BulletWorld*)world->getWorldUserInfo();
+	if(bulletWorld->tickCallback) {
+		bulletWorld->tickCallback(timeStep);
+	}
+}
\ No newline at end of file
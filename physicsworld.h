@@ -0,0 +1,59 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <utility>
+#include <btBulletDynamicsCommon.h>
+
+// Backend the simulation steps its bodies with. Objects keep their state in
+// btRigidBody either way, so Ball and Plane do not depend on the backend.
+class PhysicsWorld {
+
+public:
+	typedef std::pair<const btCollisionObject*, const btCollisionObject*> BodyPair;
+
+	virtual ~PhysicsWorld() {}
+	virtual void addRigidBody(btRigidBody* body) = 0;
+	virtual void removeRigidBody(btRigidBody* body) = 0;
+	// Same as addRigidBody for every body, backends may insert a batch faster than one by one
+	virtual void addRigidBodies(const std::vector<btRigidBody*>& bodies);
+	virtual void setGravity(double x, double y) = 0;
+	// Seconds a body allowed to sleep has to stay under its sleeping thresholds before it sleeps
+	virtual void setSleepDelay(double seconds) = 0;
+	// Same contract as btDynamicsWorld::stepSimulation, returns the number of fixed substeps taken
+	virtual int stepSimulation(double timeStep, int maxSubSteps, double fixedTimeStep = 1.0/60.0) = 0;
+	// Called with the substep length before every fixed substep
+	void setTickCallback(std::function<void(double)> callback);
+	// Appends pairs of bodies that overlapped in the last substep
+	virtual void getTouchingPairs(std::vector<BodyPair>& pairs) = 0;
+
+protected:
+	std::function<void(double)> tickCallback;
+
+};
+
+class BulletWorld: public PhysicsWorld {
+
+public:
+	BulletWorld();
+	~BulletWorld();
+	void addRigidBody(btRigidBody* body);
+	void removeRigidBody(btRigidBody* body);
+	void addRigidBodies(const std::vector<btRigidBody*>& bodies);
+	void setGravity(double x, double y);
+	void setSleepDelay(double seconds);
+	int stepSimulation(double timeStep, int maxSubSteps, double fixedTimeStep = 1.0/60.0);
+	void getTouchingPairs(std::vector<BodyPair>& pairs);
+
+private:
+	btDbvtBroadphase* broadphase;
+	// Pairs of a batch are left to the next step, until then the broadphase defers all pair finding
+	bool batchPending = false;
+	btDefaultCollisionConfiguration* collisionConfiguration;
+	btCollisionDispatcher* dispatcher;
+	btSequentialImpulseConstraintSolver* solver;
+	btDiscreteDynamicsWorld* dynamicsWorld;
+
+	static void internalTickCallback(btDynamicsWorld* world, btScalar timeStep);
+
+};
\ No newline at end of file
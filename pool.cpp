@@ -0,0 +1,35 @@
+#include "pool.h"
+#include <cstdlib>
+
+SlabAllocator::SlabAllocator(size_t blockSize, int blocksPerSlab) {
+	// A free block stores the next free block in its first bytes
+	this->blockSize = blockSize < sizeof(void*) ? sizeof(void*) : blockSize;
+	this->blocksPerSlab = blocksPerSlab;
+	slabUsed = blocksPerSlab;
+}
+
+SlabAllocator::~SlabAllocator() {
+	for(char* slab: slabs) {
+		std::free(slab);
+	}
+}
+
+void* SlabAllocator::allocate() {
+	if(freeList) {
+		void* block = freeList;
+		freeList = *(void**)block;
+		return block;
+	}
+	if(slabUsed == blocksPerSlab) {
+		char* slab = (char*)std::malloc(blockSize * blocksPerSlab);
+		if(!slab) throw std::bad_alloc();
+		slabs.push_back(slab);
+		slabUsed = 0;
+	}
+	return slabs.back() + blockSize * slabUsed++;
+}
+
+void SlabAllocator::free(void* block) {
+	*(void**)block = freeList;
+	freeList = block;
+}
\ No newline at end of file
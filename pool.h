@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Hands out fixed size blocks carved from large slabs. Freed blocks are reused
+// first, slabs go back to the system only when the allocator is destroyed.
+// Not thread safe.
+class SlabAllocator {
+
+public:
+	SlabAllocator(size_t blockSize, int blocksPerSlab);
+	~SlabAllocator();
+	void* allocate();
+	void free(void* block);
+
+private:
+	size_t blockSize;
+	int blocksPerSlab;
+	std::vector<char*> slabs;
+	// Blocks of the newest slab handed out so far
+	int slabUsed;
+	void* freeList = nullptr;
+
+};
+
+// Objects of one type packed side by side in slabs
+template<typename T> class ObjectPool {
+
+public:
+	ObjectPool(int objectsPerSlab = 1024);
+	template<typename... Args> T* create(Args&&... args);
+	void destroy(T* object);
+
+private:
+	SlabAllocator allocator;
+
+	static size_t getBlockSize();
+
+};
+
+template<typename T> ObjectPool<T>::ObjectPool(int objectsPerSlab): allocator(getBlockSize(), objectsPerSlab) {}
+
+template<typename T> template<typename... Args> T* ObjectPool<T>::create(Args&&... args) {
+	return new(allocator.allocate()) T(std::forward<Args>(args)...);
+}
+
+template<typename T> void ObjectPool<T>::destroy(T* object) {
+	object->~T();
+	allocator.free(object);
+}
+
+template<typename T> size_t ObjectPool<T>::getBlockSize() {
+	const size_t alignment = alignof(std::max_align_t);
+	return (sizeof(T) + alignment - 1) / alignment * alignment;
+}
\ No newline at end of file
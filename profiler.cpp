@@ -0,0 +1,141 @@
+#include "profiler.h"
+#include <algorithm>
+
+Profiler::Profiler() {
+	for(int phase = 0; phase < PROFILE_PHASES_NUM; phase++) {
+		samples[phase].resize(WINDOW_SIZE);
+	}
+	reset();
+}
+
+Profiler::~Profiler() {
+	closeCsv();
+}
+
+void Profiler::add(ProfilePhase phase, double milliseconds) {
+	// Each phase is only ever timed from one thread, so no lock until the frame ends
+	pending[phase] += milliseconds;
+}
+
+void Profiler::endFrame(ProfileGroup group) {
+	std::lock_guard<std::mutex> lock(mutex);
+	int sample = nextSample[group];
+	for(int phase = getFirstPhase(group); phase < getEndPhase(group); phase++) {
+		samples[phase][sample] = pending[phase];
+		totals[phase] += pending[phase];
+	}
+	nextSample[group] = (sample + 1) % WINDOW_SIZE;
+	sampleCount[group] = std::min(sampleCount[group] + 1, (int)WINDOW_SIZE);
+	frameCount[group]++;
+	if(csv.is_open()) {
+		csv << (group == PROFILE_GROUP_PHYSICS ? "physics" : "window") << "," << frameCount[group];
+		for(int phase = 0; phase < PROFILE_PHASES_NUM; phase++) {
+			csv << ",";
+			if(getGroup((ProfilePhase)phase) == group) {
+				csv << pending[phase];
+			}
+		}
+		csv << "\n";
+	}
+	for(int phase = getFirstPhase(group); phase < getEndPhase(group); phase++) {
+		pending[phase] = 0;
+	}
+}
+
+Profiler::Stats Profiler::getStats(ProfilePhase phase) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Stats stats = {0, 0, 0};
+	int count = sampleCount[getGroup(phase)];
+	if(count == 0) return stats;
+	std::vector<double> sorted(samples[phase].begin(), samples[phase].begin() + count);
+	std::sort(sorted.begin(), sorted.end());
+	stats.min = sorted.front();
+	for(double sample: sorted) {
+		stats.avg += sample;
+	}
+	stats.avg /= count;
+	stats.p99 = sorted[std::min((int)(count * 0.99), count - 1)];
+	return stats;
+}
+
+double Profiler::getTotal(ProfilePhase phase) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return totals[phase];
+}
+
+long long Profiler::getFrameCount(ProfileGroup group) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return frameCount[group];
+}
+
+void Profiler::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for(int phase = 0; phase < PROFILE_PHASES_NUM; phase++) {
+		pending[phase] = 0;
+		totals[phase] = 0;
+	}
+	for(int group = 0; group <= PROFILE_GROUP_WINDOW; group++) {
+		nextSample[group] = 0;
+		sampleCount[group] = 0;
+		frameCount[group] = 0;
+	}
+}
+
+const char* Profiler::getPhaseName(ProfilePhase phase) {
+	switch(phase) {
+		case PROFILE_PHASE_PHYSICS:			return "physics";
+		case PROFILE_PHASE_DELETE:			return "delete";
+		case PROFILE_PHASE_STEP:			return "step";
+		case PROFILE_PHASE_GRAVITY:			return "gravity";
+		case PROFILE_PHASE_SPRINGS:			return "springs";
+		case PROFILE_PHASE_APPLY_FORCES:	return "forces";
+		case PROFILE_PHASE_MERGES:			return "merges";
+		case PROFILE_PHASE_RECORD:			return "record";
+		case PROFILE_PHASE_EVENTS:			return "events";
+		case PROFILE_PHASE_RENDER:			return "render";
+		case PROFILE_PHASE_DRAW_SPRINGS:	return "draw springs";
+		case PROFILE_PHASE_DRAW_BALLS:		return "draw balls";
+		case PROFILE_PHASE_DRAW_UI:			return "draw ui";
+		default:							return "?";
+	}
+}
+
+bool Profiler::openCsv(std::string path) {
+	std::lock_guard<std::mutex> lock(mutex);
+	csv.open(path, std::ios::out | std::ios::trunc);
+	if(!csv.is_open()) return false;
+	csv << "group,frame";
+	for(int phase = 0; phase < PROFILE_PHASES_NUM; phase++) {
+		csv << "," << getPhaseName((ProfilePhase)phase);
+	}
+	csv << "\n";
+	return true;
+}
+
+void Profiler::closeCsv() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(csv.is_open()) {
+		csv.close();
+	}
+}
+
+ProfilePhase Profiler::getFirstPhase(ProfileGroup group) {
+	return group == PROFILE_GROUP_PHYSICS ? PROFILE_PHASE_PHYSICS : PROFILE_PHASE_EVENTS;
+}
+
+ProfilePhase Profiler::getEndPhase(ProfileGroup group) {
+	return group == PROFILE_GROUP_PHYSICS ? PROFILE_PHASE_EVENTS : PROFILE_PHASES_NUM;
+}
+
+ProfileGroup Profiler::getGroup(ProfilePhase phase) {
+	return phase < PROFILE_PHASE_EVENTS ? PROFILE_GROUP_PHYSICS : PROFILE_GROUP_WINDOW;
+}
+
+ScopedTimer::ScopedTimer(Profiler& profiler, ProfilePhase phase): profiler(profiler), phase(phase) {
+	start = std::chrono::steady_clock::now();
+}
+
+ScopedTimer::~ScopedTimer() {
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	profiler.add(phase, elapsed.count());
+}
\ No newline at end of file
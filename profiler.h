@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+
+// Per phase frame timings. Only built in with PHYSBOX_PROFILING defined, as the
+// Profile configuration of PhysBox and the Benchmark project do. Without it
+// the macros below expand to nothing and no clock is ever read.
+
+enum ProfilePhase {
+	// Physics side, committed at the end of every processPhysics
+	PROFILE_PHASE_PHYSICS,
+	PROFILE_PHASE_DELETE,
+	PROFILE_PHASE_STEP,
+	PROFILE_PHASE_GRAVITY,
+	PROFILE_PHASE_SPRINGS,
+	PROFILE_PHASE_APPLY_FORCES,
+	PROFILE_PHASE_MERGES,
+	PROFILE_PHASE_RECORD,
+	// Window side, committed at the end of every render
+	PROFILE_PHASE_EVENTS,
+	PROFILE_PHASE_RENDER,
+	PROFILE_PHASE_DRAW_SPRINGS,
+	PROFILE_PHASE_DRAW_BALLS,
+	PROFILE_PHASE_DRAW_UI,
+	PROFILE_PHASES_NUM
+};
+
+enum ProfileGroup {
+	PROFILE_GROUP_PHYSICS,
+	PROFILE_GROUP_WINDOW
+};
+
+class Profiler {
+
+public:
+	// Frames the rolling statistics cover
+	static const int WINDOW_SIZE = 120;
+	struct Stats {
+		double min, avg, p99;
+	};
+
+	Profiler();
+	~Profiler();
+	// Adds to the phase in the frame being timed, a phase entered several
+	// times per frame (forces run every substep) sums up
+	void add(ProfilePhase phase, double milliseconds);
+	// Ends the frame of one group, called from the thread that times its phases
+	void endFrame(ProfileGroup group);
+	// Milliseconds per frame over the last WINDOW_SIZE frames of the phase
+	Stats getStats(ProfilePhase phase);
+	// Milliseconds spent in the phase and frames ended since construction or reset()
+	double getTotal(ProfilePhase phase);
+	long long getFrameCount(ProfileGroup group);
+	void reset();
+	static const char* getPhaseName(ProfilePhase phase);
+	// Streams every committed frame as a row of milliseconds per phase
+	bool openCsv(std::string path);
+	void closeCsv();
+
+private:
+	std::mutex mutex;
+	double pending[PROFILE_PHASES_NUM];
+	// Ring of the last WINDOW_SIZE frame times per phase
+	std::vector<double> samples[PROFILE_PHASES_NUM];
+	int nextSample[PROFILE_GROUP_WINDOW + 1];
+	int sampleCount[PROFILE_GROUP_WINDOW + 1];
+	long long frameCount[PROFILE_GROUP_WINDOW + 1];
+	double totals[PROFILE_PHASES_NUM];
+	std::ofstream csv;
+
+	static ProfilePhase getFirstPhase(ProfileGroup group);
+	static ProfilePhase getEndPhase(ProfileGroup group);
+	static ProfileGroup getGroup(ProfilePhase phase);
+
+};
+
+// Adds the time until the end of the enclosing scope to a phase
+class ScopedTimer {
+
+public:
+	ScopedTimer(Profiler& profiler, ProfilePhase phase);
+	~ScopedTimer();
+
+private:
+	Profiler& profiler;
+	ProfilePhase phase;
+	std::chrono::steady_clock::time_point start;
+
+};
+
+#ifdef PHYSBOX_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(profiler, phase) ScopedTimer PROFILE_CONCAT(scopedTimer, __LINE__)(profiler, phase)
+#define PROFILE_END_FRAME(profiler, group) (profiler).endFrame(group)
+#else
+#define PROFILE_SCOPE(profiler, phase)
+#define PROFILE_END_FRAME(profiler, group)
+#endif
\ No newline at end of file
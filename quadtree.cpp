@@ -0,0 +1,132 @@
+#include "quadtree.h"
+#include <algorithm>
+#include <cmath>
+
+void QuadTree::build(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& mass) {
+	bodyX = &x;
+	bodyY = &y;
+	bodyMass = &mass;
+	nodes.clear();
+	nextBody.assign(x.size(), -1);
+	if(x.empty()) return;
+	double minX = x[0], maxX = x[0];
+	double minY = y[0], maxY = y[0];
+	for(int i = 1; i < (int)x.size(); i++) {
+		minX = std::min(minX, x[i]);
+		maxX = std::max(maxX, x[i]);
+		minY = std::min(minY, y[i]);
+		maxY = std::max(maxY, y[i]);
+	}
+	double halfSize = std::max(maxX - minX, maxY - minY) / 2 + 1;
+	addNode((minX + maxX) / 2, (minY + maxY) / 2, halfSize);
+	for(int i = 0; i < (int)x.size(); i++) {
+		insert(i);
+	}
+}
+
+void QuadTree::calculateAcceleration(int body, double theta, double& accX, double& accY) {
+	accX = 0;
+	accY = 0;
+	if(nodes.empty()) return;
+	double x = (*bodyX)[body];
+	double y = (*bodyY)[body];
+	// Local stack so several threads can query the same tree. Each opened node
+	// replaces itself with four children, so depth * 3 + 1 entries are enough.
+	int stack[MAX_DEPTH * 3 + 4];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while(stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		if(node.mass == 0) continue;
+		if(node.firstChild == -1) {
+			for(int i = node.firstBody; i != -1; i = nextBody[i]) {
+				if(i == body) continue;
+				double deltaX = (*bodyX)[i] - x;
+				double deltaY = (*bodyY)[i] - y;
+				double distance = sqrt(deltaX*deltaX + deltaY*deltaY);
+				if(distance == 0) continue;
+				double acc = (*bodyMass)[i] / (distance*distance*distance);
+				accX += deltaX * acc;
+				accY += deltaY * acc;
+			}
+			continue;
+		}
+		double deltaX = node.massX / node.mass - x;
+		double deltaY = node.massY / node.mass - y;
+		double distance = sqrt(deltaX*deltaX + deltaY*deltaY);
+		bool containsBody = std::abs(x - node.centerX) <= node.halfSize && std::abs(y - node.centerY) <= node.halfSize;
+		if(!containsBody && node.halfSize * 2 < theta * distance) {
+			double acc = node.mass / (distance*distance*distance);
+			accX += deltaX * acc;
+			accY += deltaY * acc;
+		} else {
+			for(int i = 0; i < 4; i++) {
+				stack[stackSize++] = node.firstChild + i;
+			}
+		}
+	}
+}
+
+void QuadTree::insert(int body) {
+	double x = (*bodyX)[body];
+	double y = (*bodyY)[body];
+	int current = 0;
+	int depth = 0;
+	while(true) {
+		addMass(nodes[current], body);
+		if(nodes[current].firstChild != -1) {
+			current = nodes[current].firstChild + getQuadrant(nodes[current], x, y);
+			depth++;
+			continue;
+		}
+		if(nodes[current].firstBody == -1 || depth >= MAX_DEPTH) {
+			nextBody[body] = nodes[current].firstBody;
+			nodes[current].firstBody = body;
+			return;
+		}
+		// Leaf already holds one body, push it down a level and keep descending
+		int oldBody = nodes[current].firstBody;
+		double halfSize = nodes[current].halfSize / 2;
+		double centerX = nodes[current].centerX;
+		double centerY = nodes[current].centerY;
+		int firstChild = addNode(centerX - halfSize, centerY - halfSize, halfSize);
+		addNode(centerX + halfSize, centerY - halfSize, halfSize);
+		addNode(centerX - halfSize, centerY + halfSize, halfSize);
+		addNode(centerX + halfSize, centerY + halfSize, halfSize);
+		nodes[current].firstChild = firstChild;
+		nodes[current].firstBody = -1;
+		Node& oldBodyNode = nodes[firstChild + getQuadrant(nodes[current], (*bodyX)[oldBody], (*bodyY)[oldBody])];
+		oldBodyNode.firstBody = oldBody;
+		addMass(oldBodyNode, oldBody);
+		current = firstChild + getQuadrant(nodes[current], x, y);
+		depth++;
+	}
+}
+
+int QuadTree::addNode(double centerX, double centerY, double halfSize) {
+	Node node;
+	node.centerX = centerX;
+	node.centerY = centerY;
+	node.halfSize = halfSize;
+	node.mass = 0;
+	node.massX = 0;
+	node.massY = 0;
+	node.firstChild = -1;
+	node.firstBody = -1;
+	nodes.push_back(node);
+	return (int)nodes.size() - 1;
+}
+
+int QuadTree::getQuadrant(const Node& node, double x, double y) {
+	int quadrant = 0;
+	if(x >= node.centerX) quadrant += 1;
+	if(y >= node.centerY) quadrant += 2;
+	return quadrant;
+}
+
+void QuadTree::addMass(Node& node, int body) {
+	double mass = (*bodyMass)[body];
+	node.mass += mass;
+	node.massX += mass * (*bodyX)[body];
+	node.massY += mass * (*bodyY)[body];
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+// Barnes-Hut quadtree over point masses, rebuilt from scratch every frame.
+// Node storage is kept between builds so a rebuild does not allocate once the
+// tree has reached its working size.
+class QuadTree {
+
+public:
+	void build(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& mass);
+	// Sum of mass / distance^2 along the direction to every other body,
+	// approximating far nodes by their center of mass when size / distance < theta.
+	// Safe to call from several threads at once.
+	void calculateAcceleration(int body, double theta, double& accX, double& accY);
+
+private:
+	// Bodies closer than this are kept in one leaf instead of subdividing forever
+	static const int MAX_DEPTH = 32;
+	struct Node {
+		double centerX, centerY, halfSize;
+		double mass;
+		double massX, massY;
+		int firstChild;
+		int firstBody;
+	};
+	std::vector<Node> nodes;
+	std::vector<int> nextBody;
+	const std::vector<double>* bodyX = nullptr;
+	const std::vector<double>* bodyY = nullptr;
+	const std::vector<double>* bodyMass = nullptr;
+
+	void insert(int body);
+	int addNode(double centerX, double centerY, double halfSize);
+	int getQuadrant(const Node& node, double x, double y);
+	void addMass(Node& node, int body);
+
+};
\ No newline at end of file
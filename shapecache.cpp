@@ -0,0 +1,23 @@
+#include "shapecache.h"
+#include <algorithm>
+#include <cmath>
+
+ShapeCache::~ShapeCache() {
+	clear();
+}
+
+btSphereShape* ShapeCache::getSphere(double radius) {
+	long long key = std::max(std::llround(radius * RADIUS_STEPS), 1LL);
+	btSphereShape*& sphere = spheres[key];
+	if(!sphere) {
+		sphere = new btSphereShape((double)key / RADIUS_STEPS);
+	}
+	return sphere;
+}
+
+void ShapeCache::clear() {
+	for(const std::pair<const long long, btSphereShape*>& sphere: spheres) {
+		delete sphere.second;
+	}
+	spheres.clear();
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <unordered_map>
+#include <btBulletDynamicsCommon.h>
+
+// Sphere shapes shared by all balls of the same size. Radii are rounded to
+// 1 / RADIUS_STEPS of a pixel, the rendered radius stays exact.
+class ShapeCache {
+
+public:
+	~ShapeCache();
+	btSphereShape* getSphere(double radius);
+	// Only call once no body uses the shapes any more
+	void clear();
+
+private:
+	static const int RADIUS_STEPS = 64;
+	std::unordered_map<long long, btSphereShape*> spheres;
+
+};
\ No newline at end of file
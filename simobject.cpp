@@ -1,29 +1,77 @@
 #include "simobject.h"
 #include "globals.h"
-#include <algorithm>
 
 
-void SimObject::addToRigidBodyWorld(btDynamicsWorld* world) {
+SimObject::~SimObject() {
+	if(material) material->removeUser(this);
+	delete rigidBody->getMotionState();
+	delete rigidBody;
+}
+
+void SimObject::addToRigidBodyWorld(PhysicsWorld* world) {
 	world->addRigidBody(rigidBody);
 }
 
+void SimObject::removeFromRigidBodyWorld(PhysicsWorld* world) {
+	world->removeRigidBody(rigidBody);
+}
+
+btRigidBody* SimObject::getRigidBody() {
+	return rigidBody;
+}
+
+void SimObject::allowSleeping(double linearThreshold, double angularThreshold) {
+	rigidBody->setSleepingThresholds(linearThreshold, angularThreshold);
+	// setActivationState leaves DISABLE_DEACTIVATION alone
+	rigidBody->forceActivationState(ACTIVE_TAG);
+}
+
+void SimObject::wake() {
+	rigidBody->activate();
+	if(store) store->awake[index] = 1;
+}
+
+void SimObject::pullFromRigidBody() {
+	// The body transform is current inside substeps, the motion state only after the whole step
+	const btVector3& position = rigidBody->getWorldTransform().getOrigin();
+	const btVector3& velocity = rigidBody->getLinearVelocity();
+	store->x[index] = position.getX();
+	store->y[index] = position.getY();
+	store->velX[index] = velocity.x();
+	store->velY[index] = velocity.y();
+	store->awake[index] = rigidBody->isActive();
+	// Woken by a contact, what was held back no longer matches the body's state
+	if(store->awake[index]) {
+		store->pendingVelX[index] = 0;
+		store->pendingVelY[index] = 0;
+	}
+}
+
+void SimObject::pushToRigidBody() {
+	rigidBody->setLinearVelocity(btVector3(store->velX[index], store->velY[index], 0));
+}
+
 double SimObject::getX() {
+	if(store) return store->x[index];
 	btTransform t;
 	rigidBody->getMotionState()->getWorldTransform(t);
 	return t.getOrigin().getX();
 }
 
 double SimObject::getY() {
+	if(store) return store->y[index];
 	btTransform t;
 	rigidBody->getMotionState()->getWorldTransform(t);
 	return t.getOrigin().getY();
 }
 
 double SimObject::getVelX() {
+	if(store) return store->velX[index];
 	return rigidBody->getLinearVelocity().x();
 }
 
 double SimObject::getVelY() {
+	if(store) return store->velY[index];
 	return rigidBody->getLinearVelocity().y();
 }
 
@@ -35,92 +83,87 @@ double SimObject::getRotation() {
 }
 
 void SimObject::setX(double x) {
+	if(store) store->x[index] = x;
 	btTransform t;
 	rigidBody->getMotionState()->getWorldTransform(t);
-	t.setOrigin(btVector3(x, getY(), 0));
+	t.getOrigin().setX(x);
 	rigidBody->getMotionState()->setWorldTransform(t);
+	rigidBody->getWorldTransform().getOrigin().setX(x);
 }
 
 void SimObject::setY(double y) {
+	if(store) store->y[index] = y;
 	btTransform t;
 	rigidBody->getMotionState()->getWorldTransform(t);
-	t.setOrigin(btVector3(getX(), y, 0));
+	t.getOrigin().setY(y);
 	rigidBody->getMotionState()->setWorldTransform(t);
+	rigidBody->getWorldTransform().getOrigin().setY(y);
 }
 
 void SimObject::setVelX(double velX) {
-	rigidBody->setLinearVelocity(btVector3(velX, getVelY(), 0));
+	if(store) store->velX[index] = velX;
+	btVector3 velocity = rigidBody->getLinearVelocity();
+	velocity.setX(velX);
+	rigidBody->setLinearVelocity(velocity);
 }
 
 void SimObject::setVelY(double velY) {
-	rigidBody->setLinearVelocity(btVector3(getVelX(), velY, 0));
+	if(store) store->velY[index] = velY;
+	btVector3 velocity = rigidBody->getLinearVelocity();
+	velocity.setY(velY);
+	rigidBody->setLinearVelocity(velocity);
+}
+
+void SimObject::setMaterial(Material* material) {
+	if(this->material) this->material->removeUser(this);
+	this->material = material;
+	if(material) material->addUser(this);
+	applyMaterial();
+}
+
+Material* SimObject::getMaterial() {
+	return material;
 }
 
 void SimObject::setRestitution(double restitution) {
+	hasOwnRestitution = true;
 	rigidBody->setRestitution(restitution);
 }
 
 void SimObject::setFriction(double friction) {
+	hasOwnFriction = true;
 	rigidBody->setFriction(friction);
 }
 
+void SimObject::applyMaterial() {
+	if(!material) return;
+	if(!hasOwnRestitution) rigidBody->setRestitution(material->getRestitution());
+	if(!hasOwnFriction) rigidBody->setFriction(material->getFriction());
+}
+
 double SimObject::distanceBetween(SimObject* object1, SimObject* object2) {
 		double deltaX = object1->getX() - object2->getX();
 		double deltaY = object1->getY() - object2->getY();
 		return sqrt(deltaX*deltaX + deltaY*deltaY);
 }
 
-void SimObject::calculateGravity(SimObject* anotherObject, double delta, double gravityRadialForce) {
-	double distance = distanceBetween(this, anotherObject);
+// Force kernels only add to this object's force in the particle store, so objects
+// can be processed in parallel. Simulation::applyForces turns the sums into velocity.
+void SimObject::calculateGravity(SimObject* anotherObject, double gravityRadialForce) {
+	int other = anotherObject->index;
+	double deltaX = store->x[other] - store->x[index];
+	double deltaY = store->y[other] - store->y[index];
+	double distance = sqrt(deltaX*deltaX + deltaY*deltaY);
 	if(distance == 0) return;
-	double force = gravityRadialForce * getMass() * anotherObject->getMass() / (distance*distance);
-	double forceX = (anotherObject->getX() - getX()) / distance * force;
-	double forceY = (anotherObject->getY() - getY()) / distance * force;
-	double velX = getVelX();
-	double velY = getVelY();
-	velX += forceX / getMass() * delta;
-	velY += forceY / getMass() * delta;
-	setVelX(velX);
-	setVelY(velY);
-}
-
-void SimObject::calculateSprings(SimObject* anotherObject, double delta,
-	double springMaxDistance, double springDistance, double springDamping, double springForce) {
-
-	double distance = distanceBetween(this, anotherObject);
-	if(distance == 0) return;
-	if(springMaxDistance > 0 && distance > springMaxDistance) {
-		springConnections.erase(std::remove(springConnections.begin(), springConnections.end(), anotherObject), springConnections.end());
-		anotherObject->incomingSpringConnectionsCount--;
-		return;
-	}
-	double offset = distance - springDistance;
-	double relativeSpeedX = anotherObject->getVelX() - getVelX();
-	double relativeSpeedY = anotherObject->getVelY() - getVelY();
-	//TODO remake damping
-	double relativeSpeed = sqrt(relativeSpeedX*relativeSpeedX + relativeSpeedY*relativeSpeedY);
-	double dampingForce = relativeSpeed * springDamping;
-	double dampingForceX, dampingForceY;
-	if(relativeSpeed != 0) {
-		dampingForceX = relativeSpeedX / relativeSpeed * dampingForce;
-		dampingForceY = relativeSpeedY / relativeSpeed * dampingForce;
-	} else {
-		dampingForceX = 0;
-		dampingForceY = 0;
-	}
-	double force;
-	force = offset * springForce - dampingForce;
-	double forceX = (anotherObject->getX() - getX()) / distance * force + dampingForceX;
-	double forceY = (anotherObject->getY() - getY()) / distance * force + dampingForceY;
-	double velX = getVelX();
-	double velY = getVelY();
-	velX += forceX / getMass() * delta;
-	velY += forceY / getMass() * delta;
-	setVelX(velX);
-	setVelY(velY);
+	double mass = 1.0 / store->invMass[index];
+	double anotherMass = 1.0 / store->invMass[other];
+	double force = gravityRadialForce * mass * anotherMass / (distance*distance);
+	store->forceX[index] += deltaX / distance * force;
+	store->forceY[index] += deltaY / distance * force;
 }
 
 double SimObject::getMass() {
+	if(store) return 1.0 / store->invMass[index];
 	return 1.0 / rigidBody->getInvMass();
 }
 
@@ -128,15 +171,17 @@ void SimObject::setMass(double mass) {
 	btVector3 inertia;
 	rigidBody->getCollisionShape()->calculateLocalInertia(mass, inertia);
 	rigidBody->setMassProps(mass, inertia);
+	if(store) store->invMass[index] = rigidBody->getInvMass();
 }
 
 ObjectType SimObject::getObjectType() {
 	return objectType;
 }
 
-Ball::Ball(double x, double y, double radius, double speedX, double speedY, sf::Color color, bool isActive) {
+Ball::Ball(ParticleStore* store, ShapeCache* shapeCache, double x, double y, double radius, double speedX, double speedY,
+	sf::Color color, bool isActive) {
 	
-	btCollisionShape* shape = new btSphereShape(radius);
+	btCollisionShape* shape = shapeCache->getSphere(radius);
 	btDefaultMotionState* mState = new btDefaultMotionState(btTransform(btQuaternion(0, 0, 0, 1), btVector3(x, y, 0)));
 	double mass;
 	if(isActive) {
@@ -149,27 +194,25 @@ Ball::Ball(double x, double y, double radius, double speedX, double speedY, sf::
 	btRigidBody::btRigidBodyConstructionInfo ci(mass, mState, shape, inertia);
 	rigidBody = new btRigidBody(ci);
 	rigidBody->setActivationState(DISABLE_DEACTIVATION);
-	rigidBody->setRestitution(defaultRestitution);
 	rigidBody->setDamping(0, 0);
-	rigidBody->setFriction(defaultFriction);
 
-	setVelX(speedX);
-	setVelY(speedY);
+	rigidBody->setLinearVelocity(btVector3(speedX, speedY, 0));
+	rigidBody->setUserPointer(this);
 
-	this->radius = radius;
-	this->color = color;
+	this->store = store;
+	this->shapeCache = shapeCache;
+	index = store->add(x, y, speedX, speedY, rigidBody->getInvMass(), radius, color);
 	this->isActive = isActive;
 	objectType = OBJECT_TYPE_BALL;
 
 }
 
-void Ball::render() {
-	sf::CircleShape circle(radius);
-	circle.setOrigin(radius, radius);
-	circle.setFillColor(color);
-	circle.setPosition(getX(), getY());
-	circle.setRotation(getRotation() * 180 / PI);
-	mainWindow.draw(circle);
+double Ball::getRadius() {
+	return store->radius[index];
+}
+
+sf::Color Ball::getColor() {
+	return store->color[index];
 }
 
 double Ball::calculateMass(double rad) {
@@ -177,12 +220,15 @@ double Ball::calculateMass(double rad) {
 }
 
 void Ball::recalculateRadius() {
-	radius = sqrt(getMass() / PI);
+	double radius = sqrt(getMass() / PI);
+	store->radius[index] = radius;
+	// Both backends take the AABB and contact size from the shape on the next step
+	rigidBody->setCollisionShape(shapeCache->getSphere(radius));
+	setMass(getMass());
 }
 
 void Ball::mergeBalls(Ball* ball1, Ball* ball2, double delta) {
 	if(ball1->isMarkedForDeletion || ball2->isMarkedForDeletion) return;
-	if(!((distanceBetween(ball1, ball2) < ball1->radius + ball2->radius))) return;
 	Ball* big;
 	Ball* small;
 	if(ball1->getMass() >= ball2->getMass()) {
@@ -198,34 +244,41 @@ void Ball::mergeBalls(Ball* ball1, Ball* ball2, double delta) {
 	big->setY(massCenterY);
 	big->setVelX((big->getMass() * big->getVelX() + small->getMass() * small->getVelX()) / (big->getMass() + small->getMass()));
 	big->setVelY((big->getMass() * big->getVelY() + small->getMass() * small->getVelY()) / (big->getMass() + small->getMass()));
-	big->color = {
-		(unsigned char)((big->getMass() * big->color.r + small->getMass() * small->color.r) / (big->getMass() + small->getMass())),
-		(unsigned char)((big->getMass() * big->color.g + small->getMass() * small->color.g) / (big->getMass() + small->getMass())),
-		(unsigned char)((big->getMass() * big->color.b + small->getMass() * small->color.b) / (big->getMass() + small->getMass()))
+	sf::Color bigColor = big->getColor();
+	sf::Color smallColor = small->getColor();
+	big->store->color[big->index] = {
+		(unsigned char)((big->getMass() * bigColor.r + small->getMass() * smallColor.r) / (big->getMass() + small->getMass())),
+		(unsigned char)((big->getMass() * bigColor.g + small->getMass() * smallColor.g) / (big->getMass() + small->getMass())),
+		(unsigned char)((big->getMass() * bigColor.b + small->getMass() * smallColor.b) / (big->getMass() + small->getMass()))
 	};
 	big->setMass(big->getMass() + small->getMass());
 	big->recalculateRadius();
+	// A sleeping ball would keep its old contacts around the new radius
+	big->wake();
 	small->isMarkedForDeletion = true;
 }
 
-Plane::Plane(PlaneSide side) {
+Plane::Plane(PlaneSide side, double worldWidth, double worldHeight) {
+	this->side = side;
 	btVector3 rot;
 	btVector3 pos;
 	switch(side) {
 		case Plane::POS_LEFT:	 rot = btVector3( 1,  0,  0); pos = btVector3(0,					  0,					  0); break;
-		case Plane::POS_RIGHT:	 rot = btVector3(-1,  0,  0); pos = btVector3(mainWindow.getSize().x, 0,					  0); break;
+		case Plane::POS_RIGHT:	 rot = btVector3(-1,  0,  0); pos = btVector3(worldWidth,			  0,					  0); break;
 		case Plane::POS_TOP:	 rot = btVector3( 0,  1,  0); pos = btVector3(0,					  0,					  0); break;
-		case Plane::POS_BOTTOM:	 rot = btVector3( 0, -1,  0); pos = btVector3(0,					  mainWindow.getSize().y, 0); break;
+		case Plane::POS_BOTTOM:	 rot = btVector3( 0, -1,  0); pos = btVector3(0,					  worldHeight,			  0); break;
 	}
 	btCollisionShape* shape = new btStaticPlaneShape(rot, 1);
 	btDefaultMotionState* mState = new btDefaultMotionState(btTransform(btQuaternion(0, 0, 0, 1), pos));
 	btRigidBody::btRigidBodyConstructionInfo ci(0, mState, shape, btVector3(0, 0, 0));
 	rigidBody = new btRigidBody(ci);
 	rigidBody->setActivationState(DISABLE_DEACTIVATION);
-	rigidBody->setRestitution(defaultRestitution);
-	rigidBody->setFriction(defaultFriction);
 }
 
-void Plane::render() {
+Plane::~Plane() {
+	delete rigidBody->getCollisionShape();
 }
 
+Plane::PlaneSide Plane::getSide() {
+	return side;
+}
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "utils.h"
+#include "particlestore.h"
+#include "physicsworld.h"
+#include "shapecache.h"
+#include "material.h"
 #include <vector>
 #include <btBulletDynamicsCommon.h>
 
@@ -14,17 +18,24 @@ enum CollisionType {
 	COLLISION_TYPES_NUM
 };
 
-static double defaultRestitution;
-static double defaultFriction;
-
 class SimObject {
 
 public:
 	double isActive = true;
-	std::vector<SimObject*> springConnections;
-	int incomingSpringConnectionsCount = 0;
 	bool isMarkedForDeletion = false;
-	void addToRigidBodyWorld(btDynamicsWorld* world);
+	// Position in the particle store and in Simulation::objects, -1 if not stored
+	int index = -1;
+	// Frees the body with its motion state, remove it from the world first
+	virtual ~SimObject();
+	void addToRigidBodyWorld(PhysicsWorld* world);
+	void removeFromRigidBodyWorld(PhysicsWorld* world);
+	btRigidBody* getRigidBody();
+	// Bodies are created never sleeping, this lets the body sleep once it stays
+	// slower than the thresholds for the backend's sleep delay
+	void allowSleeping(double linearThreshold, double angularThreshold);
+	void wake();
+	void pullFromRigidBody();
+	void pushToRigidBody();
 	double getX();
 	double getY();
 	double getVelX();
@@ -34,33 +45,47 @@ public:
 	void setY(double y);
 	void setVelX(double velX);
 	void setVelY(double velY);
+	void setMaterial(Material* material);
+	Material* getMaterial();
+	// Restitution and friction come from the material unless set on the object itself
 	void setRestitution(double restitution);
 	void setFriction(double friction);
-	virtual void render() = 0;
+	void applyMaterial();
 	static double distanceBetween(SimObject* object1, SimObject* object2);
-	void calculateGravity(SimObject* anotherObject, double delta, double gravityRadialForce);
-	void calculateSprings(SimObject* anotherObject, double delta,
-		double springMaxDistance, double springDistance, double springDamping, double springForce);
+	void calculateGravity(SimObject* anotherObject, double gravityRadialForce);
 	double getMass();
 	void setMass(double mass);
 	ObjectType getObjectType();
 
 protected:
 	btRigidBody* rigidBody;
-	sf::Color color;
+	ParticleStore* store = nullptr;
 	ObjectType objectType;
+	Material* material = nullptr;
+	bool hasOwnRestitution = false;
+	bool hasOwnFriction = false;
+
+private:
+	friend class Material;
+	// Position in the material's user list
+	int materialSlot = -1;
 
 };
 
 class Ball: public SimObject {
 public:
-	Ball(double x, double y, double radius, double speedX, double speedY, sf::Color color, bool isActive = true);
-	void render();
+	Ball(ParticleStore* store, ShapeCache* shapeCache, double x, double y, double radius, double speedX, double speedY,
+		sf::Color color, bool isActive = true);
+	double getRadius();
+	sf::Color getColor();
+	// Also moves the body to the shared shape of the new size
 	void recalculateRadius();
+	// Caller makes sure the balls touch and both can move, the heavier one absorbs the other
 	static void mergeBalls(Ball* ball1, Ball* ball2, double delta);
 
 private:
-	double radius;
+	ShapeCache* shapeCache;
+
 	double calculateMass(double rad);
 };
 
@@ -72,7 +97,11 @@ public:
 		POS_TOP,
 		POS_BOTTOM
 	};
-	Plane(PlaneSide side);
-	void render();
+	Plane(PlaneSide side, double worldWidth, double worldHeight);
+	~Plane();
+	PlaneSide getSide();
+
+private:
+	PlaneSide side;
 
 };
\ No newline at end of file
@@ -2,12 +2,48 @@
 
 sf::RenderWindow mainWindow;
 
-Simulation::Simulation(std::function<bool(Simulation*)> exitConditionFunction) {
+Simulation::Simulation(std::function<bool(Simulation*)> exitConditionFunction, std::string configFile) {
 	this->exitContidionFunction = exitConditionFunction;
-	initSFML();
-	initBullet();
-	loadConfig();
-	loadMedia();
+	if(configFile.empty()) {
+		headless = true;
+	} else {
+		loadConfig(configFile);
+	}
+	if(!headless) {
+		initSFML();
+		worldWidth = mainWindow.getSize().x;
+		worldHeight = mainWindow.getSize().y;
+		loadMedia();
+		initRenderTables();
+	}
+	if(replay && !replayReader.open(replayFile)) {
+		std::cout << "Could not open replay " << replayFile << std::endl;
+		replay = false;
+	}
+	if(!replay) {
+		initPhysics();
+	}
+	int threads = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+	threadPool = new ThreadPool(std::max(threads, 1));
+	if(threadedPhysics && !headless && !replay) {
+		// Force pass and drawing run at the same time and cannot share a pool
+		renderThreadPool = new ThreadPool(std::max(threads / 4, 1));
+	} else {
+		renderThreadPool = threadPool;
+	}
+	// Never run an instruction set the CPU does not have
+	gravitykernel::KernelType bestKernel = gravitykernel::detectBestKernel();
+	if(gravityKernel > bestKernel) {
+		gravityKernel = bestKernel;
+	}
+#ifdef PHYSBOX_PROFILING
+	if(!profileFile.empty() && !profiler.openCsv(profileFile)) {
+		std::cout << "Could not open " << profileFile << std::endl;
+	}
+#endif
+	if(recordOnStart) {
+		toggleRecording();
+	}
 	this->exitContidionFunction = exitConditionFunction;
 }
 
@@ -16,9 +52,32 @@ Simulation::~Simulation() {
 }
 
 double Simulation::runSimulation() {
+	if(headless) {
+		return runHeadless();
+	}
+	if(replay) {
+		return runReplay();
+	}
+	if(threadedPhysics) {
+		return runThreaded();
+	}
 	while(!exitRequest) {
 		handleEvents();
 		processPhysics();
+		publishFrame();
+		render();
+		updateFpsCount();
+		checkExitCondition();
+	}
+	return 0;
+}
+
+double Simulation::runReplay() {
+	seekReplay(0);
+	while(!exitRequest) {
+		handleEvents();
+		processReplay();
+		publishFrame();
 		render();
 		updateFpsCount();
 		checkExitCondition();
@@ -26,6 +85,156 @@ double Simulation::runSimulation() {
 	return 0;
 }
 
+double Simulation::runThreaded() {
+	physicsStopping = false;
+	physicsThread = std::thread(&Simulation::physicsLoop, this);
+	while(!exitRequest) {
+		handleEvents();
+		render();
+		updateFpsCount();
+	}
+	stopPhysicsThread();
+	return 0;
+}
+
+void Simulation::physicsLoop() {
+	stepCount = 0;
+	stepClock.restart();
+	while(!exitRequest && !physicsStopping) {
+		commands.runAll();
+		if(!pause) {
+			processPhysics();
+			stepCount++;
+		}
+		updateStepCount();
+		publishFrame();
+		checkExitCondition();
+		if(pause) {
+			commands.wait(std::chrono::milliseconds(PAUSED_WAIT_MS));
+		}
+	}
+}
+
+void Simulation::stopPhysicsThread() {
+	if(!physicsThread.joinable()) return;
+	physicsStopping = true;
+	commands.wake();
+	physicsThread.join();
+	// Commands that came in after the last step still apply
+	commands.runAll();
+}
+
+void Simulation::post(std::function<void()> command) {
+	if(physicsThread.joinable()) {
+		commands.push(command);
+	} else {
+		command();
+	}
+}
+
+void Simulation::publishFrame() {
+	Frame& frame = frames.getWriteBuffer();
+	frame.x.assign(particles.x.begin(), particles.x.end());
+	frame.y.assign(particles.y.begin(), particles.y.end());
+	frame.radius.assign(particles.radius.begin(), particles.radius.end());
+	frame.color.assign(particles.color.begin(), particles.color.end());
+	if(springsEnabled) {
+		// Replays bring their own edges
+		if(!replay) {
+			collectSpringEdges();
+		}
+		frame.springEdges = springEdges;
+	} else {
+		frame.springEdges.clear();
+	}
+	frame.time = time;
+	frame.springMaxDistance = springMaxDistance;
+	frame.pause = pause;
+	frame.collisionsEnabled = collisionsEnabled;
+	frame.gravityRadialEnabled = gravityRadialEnabled;
+	frame.gravityVerticalEnabled = gravityVerticalEnabled;
+	frame.backgroundFrictionEnabled = backgroundFrictionEnabled;
+	frame.springsEnabled = springsEnabled;
+	frame.collisionType = collisionType;
+	frame.gravityMode = gravityMode;
+	frame.simulationSpeed = simulationSpeed;
+	frame.simulationSpeedExponent = simulationSpeedExponent;
+	frame.gravityRadialForce = gravityRadialForce;
+	frame.barnesHutTheta = barnesHutTheta;
+	frame.gravityVerticalForce = gravityVerticalForce;
+	frame.restitution = defaultMaterial.getRestitution();
+	frame.recordedFrames = recorder.isRecording() ? recorder.getFrameCount() : -1;
+	frame.stepsPerSecond = stepsPerSecond;
+	frame.subSteps = stepScheduler.getSubSteps();
+	frame.droppedSubSteps = stepScheduler.getDroppedSubSteps();
+	frame.sleepingObjects = -1;
+	if(sleepEnabled) {
+		frame.sleepingObjects = 0;
+		for(int i = 0; i < particles.size(); i++) {
+			if(!particles.awake[i] && particles.invMass[i] != 0) {
+				frame.sleepingObjects++;
+			}
+		}
+	}
+	frames.publish();
+}
+
+void Simulation::quit() {
+	// Leaves through exit() without unwinding, so finish the recording by hand
+	stopPhysicsThread();
+	recorder.stop();
+	exit(EXIT_SUCCESS);
+}
+
+void Simulation::processReplay() {
+	if(pause) return;
+	int lastFrame = replayReader.getFrameCount() - 1;
+	replayPosition += simulationSpeed;
+	if(replayPosition >= lastFrame) {
+		replayPosition = lastFrame;
+		pause = true;
+	}
+	// Frames passed over at high speed are never shown, far jumps decode from the nearest keyframe
+	int frame = (int)replayPosition;
+	if(frame != replayFrame) {
+		seekReplay(frame);
+	}
+}
+
+void Simulation::seekReplay(int frame) {
+	frame = std::max(std::min(frame, replayReader.getFrameCount() - 1), 0);
+	if(!replayReader.readFrame(frame, particles, springEdges)) return;
+	if(frame != (int)replayPosition) {
+		replayPosition = frame;
+	}
+	replayFrame = frame;
+	time = replayReader.getFrameTime(frame);
+}
+
+double Simulation::runHeadless() {
+	pause = false;
+	int steps = 0;
+	sf::Clock runClock;
+	while(!exitRequest && (headlessSteps <= 0 || steps < headlessSteps)) {
+		processPhysics();
+		steps++;
+		checkExitCondition();
+	}
+	double seconds = runClock.getElapsedTime().asSeconds();
+	std::cout << steps << " steps in " << seconds << " s";
+	if(seconds > 0) {
+		std::cout << " (" << steps / seconds << " steps/s)";
+	}
+	std::cout << std::endl;
+	if(gravityRadialEnabled && gravityMode == GRAVITY_MODE_DIRECT) {
+		std::cout << "Gravity kernel: " << gravitykernel::getKernelName(gravityKernel) << std::endl;
+	}
+	if(stepScheduler.getTotalDroppedSubSteps() > 0) {
+		std::cout << stepScheduler.getTotalDroppedSubSteps() << " substeps dropped over maxSubSteps" << std::endl;
+	}
+	return seconds;
+}
+
 void Simulation::initSFML() {
 	
 	sf::ContextSettings settings;
@@ -35,24 +244,51 @@ void Simulation::initSFML() {
 
 }
 
-void Simulation::initBullet() {
-	btBroadphaseInterface* broadphase = new btDbvtBroadphase();
-	btDefaultCollisionConfiguration* collisionConfiguration = new btDefaultCollisionConfiguration();
-	btCollisionDispatcher* dispatcher = new btCollisionDispatcher(collisionConfiguration);
-	btSequentialImpulseConstraintSolver* solver = new btSequentialImpulseConstraintSolver();
-	dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
-	dynamicsWorld->setGravity(btVector3(0, gravityVerticalForce, 0));
+void Simulation::initPhysics() {
+	bulletallocator::install();
+	switch(physicsBackend) {
+		case PHYSICS_BACKEND_BULLET: physicsWorld = new BulletWorld(); break;
+		case PHYSICS_BACKEND_CIRCLE: physicsWorld = new CircleWorld(); break;
+	}
+	physicsWorld->setGravity(0, gravityVerticalForce);
+	physicsWorld->setSleepDelay(sleepDelay);
+	stepScheduler.reset();
+	stepScheduler.fixedTimeStep = fixedTimeStep;
+	stepScheduler.maxSubSteps = maxSubSteps;
+	stepScheduler.budget = headless ? 0 : stepBudget;
+	physicsWorld->setTickCallback([this](double timeStep) {
+		// Contacts of the previous substep, so balls that touch and bounce apart within one frame still merge
+		if(isMergeEnabled()) {
+			physicsWorld->getTouchingPairs(touchingPairs);
+		}
+		// Force constants are tuned per rendered frame of SECONDS_PER_FRAME
+		processForces(timeStep / SECONDS_PER_FRAME);
+	});
 }
 
 bool Simulation::loadMedia() {
 	return font.loadFromFile("arial.ttf");
 }
 
-void Simulation::loadConfig() {
+void Simulation::loadConfig(std::string path) {
 
 	libconfig::Config cfg;
 
-    cfg.readFile("simulation_settings.cfg");
+    cfg.readFile(path.c_str());
+	cfg.lookupValue("headless", headless);
+	cfg.lookupValue("headlessSteps", headlessSteps);
+	cfg.lookupValue("replayFile", replayFile);
+	replay = !headless && !replayFile.empty();
+	cfg.lookupValue("threadedPhysics", threadedPhysics);
+	cfg.lookupValue("worldWidth", worldWidth);
+	cfg.lookupValue("worldHeight", worldHeight);
+	int _physicsBackend = PHYSICS_BACKEND_BULLET;
+	cfg.lookupValue("physicsBackend", _physicsBackend);
+	switch(_physicsBackend) {
+		case 0:  physicsBackend = PHYSICS_BACKEND_BULLET;	break;
+		case 1:	 physicsBackend = PHYSICS_BACKEND_CIRCLE;	break;
+		default: physicsBackend = PHYSICS_BACKEND_BULLET;	break;
+	}
     collisionsEnabled			= cfg.lookup("collisionsEnabled");
     gravityRadialEnabled		= cfg.lookup("gravityRadialEnabled");
     gravityVerticalEnabled		= cfg.lookup("gravityVerticalEnabled");
@@ -65,107 +301,269 @@ void Simulation::loadConfig() {
 		case 1:	 collisionType = COLLISION_TYPE_MERGE;	break;
 		default: collisionType = COLLISION_TYPE_BOUNCE;	break;
 	}
+	int _gravityMode = GRAVITY_MODE_PAIRWISE;
+	cfg.lookupValue("gravityMode", _gravityMode);
+	switch(_gravityMode) {
+		case 0:  gravityMode = GRAVITY_MODE_PAIRWISE;	break;
+		case 1:	 gravityMode = GRAVITY_MODE_BARNES_HUT;	break;
+		case 2:	 gravityMode = GRAVITY_MODE_DIRECT;		break;
+		default: gravityMode = GRAVITY_MODE_PAIRWISE;	break;
+	}
 	gravityVerticalForce	= cfg.lookup("gravityVerticalForce");
 	gravityRadialForce		= cfg.lookup("gravityRadialForce");
+	cfg.lookupValue("barnesHutTheta", barnesHutTheta);
+	int _gravityKernel = -1;
+	cfg.lookupValue("gravityKernel", _gravityKernel);
+	switch(_gravityKernel) {
+		case 0:  gravityKernel = gravitykernel::KERNEL_SCALAR;	break;
+		case 1:	 gravityKernel = gravitykernel::KERNEL_SSE2;	break;
+		case 2:	 gravityKernel = gravitykernel::KERNEL_AVX2;	break;
+		// Auto, the best kernel the CPU supports
+		default: gravityKernel = gravitykernel::KERNEL_AVX2;	break;
+	}
 	springForce				= cfg.lookup("springForce");
 	springDamping			= cfg.lookup("springDamping");
 	springDistance			= cfg.lookup("springDistance");
 	springMaxDistance		= springDistance * 1.25;
 	springMaxConnections	= cfg.lookup("springMaxConnections");
+	cfg.lookupValue("fixedTimeStep", fixedTimeStep);
+	cfg.lookupValue("maxSubSteps", maxSubSteps);
+	cfg.lookupValue("stepBudget", stepBudget);
+	cfg.lookupValue("sleepEnabled", sleepEnabled);
+	cfg.lookupValue("sleepLinearThreshold", sleepLinearThreshold);
+	cfg.lookupValue("sleepAngularThreshold", sleepAngularThreshold);
+	cfg.lookupValue("sleepDelay", sleepDelay);
+	cfg.lookupValue("threadCount", threadCount);
+	cfg.lookupValue("snapshotFile", snapshotFile);
+	cfg.lookupValue("recordFile", recordFile);
+	cfg.lookupValue("recordOnStart", recordOnStart);
+	cfg.lookupValue("recordPrecision", recordPrecision);
+	cfg.lookupValue("recordKeyframeInterval", recordKeyframeInterval);
+	cfg.lookupValue("profileFile", profileFile);
 	backgroundFrictionForce	= cfg.lookup("backgroundFrictionForce");
 	cubicPixelMass			= cfg.lookup("cubicPixelMass");
 	bumpSpeed				= cfg.lookup("bumpSpeed");
 	gravityIncrement		= cfg.lookup("gravityIncrement");
-	defaultRestitution		= cfg.lookup("defaultRestitution");
-	defaultFriction			= cfg.lookup("defaultFriction");
+	double defaultRestitution	= cfg.lookup("defaultRestitution");
+	double defaultFriction		= cfg.lookup("defaultFriction");
+	defaultMaterial.setRestitution(defaultRestitution);
+	defaultMaterial.setFriction(defaultFriction);
+	double wallRestitution = defaultRestitution;
+	double wallFriction = defaultFriction;
+	cfg.lookupValue("wallRestitution", wallRestitution);
+	cfg.lookupValue("wallFriction", wallFriction);
+	wallMaterial.setRestitution(wallRestitution);
+	wallMaterial.setFriction(wallFriction);
 
 }
 
 void Simulation::close() {
-	deleteAllObjects();
+	stopPhysicsThread();
+	recorder.stop();
+	if(!replay) {
+		deleteAllObjects();
+	}
+	delete physicsWorld;
+	physicsWorld = nullptr;
+	if(renderThreadPool != threadPool) {
+		delete renderThreadPool;
+	}
+	renderThreadPool = nullptr;
+	delete threadPool;
+	threadPool = nullptr;
 }
 
 void Simulation::render() {
-	mainWindow.clear(sf::Color::Black);
-	drawSprings();
-	for(SimObject* object: objects) {
-		object->render();
-	}
-	if(uiEnabled) {
-		drawUIText();
-	}
-	mainWindow.display();
-}
-
-void Simulation::drawSprings() {
-	if(!springsEnabled) return;
-	for(SimObject* object1: objects) {
-		for(SimObject* object2: objects) {
-			if(std::find(object1->springConnections.begin(), object1->springConnections.end(),
-				object2) != object1->springConnections.end()) {
-				int opacity;
-				double distance = SimObject::distanceBetween(object1, object2);
-				if(distance > springMaxDistance) {
-					opacity = 0;
-				} else {
-					double k = -255 / springMaxDistance;
-					double b = -k * springMaxDistance;
-					opacity = (int)(k * distance + b);
-				}
-				int Hue = (int)utils::mapRange(opacity, 0, 255, 120, 0);
-				sf::Color springColor = utils::HSVtoRGB(Hue, 100, 100);
-				sf::VertexArray lines(sf::LineStrip, 2);
-				lines[0].position = sf::Vector2f(object1->getX(), object1->getY());
-				lines[1].position = sf::Vector2f(object2->getX(), object2->getY());
-				lines[0].color = sf::Color(springColor.r, springColor.g, springColor.b, opacity);
-				lines[1].color = sf::Color(springColor.r, springColor.g, springColor.b, opacity);
-				mainWindow.draw(lines);
-			}
+	{
+		PROFILE_SCOPE(profiler, PROFILE_PHASE_RENDER);
+		// Keeps drawing the previous frame until physics publishes a new one
+		frames.acquire();
+		const Frame& frame = frames.getReadBuffer();
+		mainWindow.clear(sf::Color::Black);
+		drawSprings(frame);
+		drawBalls(frame);
+		if(uiEnabled) {
+			drawUIText(frame);
+		}
+		mainWindow.display();
+	}
+	PROFILE_END_FRAME(profiler, PROFILE_GROUP_WINDOW);
+}
+
+void Simulation::initRenderTables() {
+	ballVertices.setPrimitiveType(sf::Triangles);
+	springVertices.setPrimitiveType(sf::Lines);
+	for(int opacity = 0; opacity < 256; opacity++) {
+		int Hue = (int)utils::mapRange(opacity, 0, 255, 120, 0);
+		sf::Color springColor = utils::HSVtoRGB(Hue, 100, 100);
+		springColors[opacity] = sf::Color(springColor.r, springColor.g, springColor.b, opacity);
+	}
+	for(int segments = MIN_CIRCLE_SEGMENTS; segments <= MAX_CIRCLE_SEGMENTS; segments++) {
+		circlePoints[segments].resize(segments + 1);
+		for(int i = 0; i < segments; i++) {
+			double angle = FULL_TURN * i / segments;
+			circlePoints[segments][i] = sf::Vector2f((float)cos(angle), (float)sin(angle));
 		}
+		// Same point as the first, so the fan closes without a gap
+		circlePoints[segments][segments] = circlePoints[segments][0];
+	}
+}
+
+int Simulation::getCircleSegments(double radius) {
+	int segments = (int)ceil(FULL_TURN * radius / CIRCLE_SEGMENT_LENGTH);
+	return std::min(std::max(segments, MIN_CIRCLE_SEGMENTS), MAX_CIRCLE_SEGMENTS);
+}
+
+void Simulation::drawBalls(const Frame& frame) {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_DRAW_BALLS);
+	// All balls go into one reusable triangle list and are drawn with a single call
+	int count = (int)frame.x.size();
+	ballVertexOffsets.resize(count + 1);
+	ballVertexOffsets[0] = 0;
+	for(int i = 0; i < count; i++) {
+		ballVertexOffsets[i + 1] = ballVertexOffsets[i] + getCircleSegments(frame.radius[i]) * 3;
 	}
+	ballVertices.resize(ballVertexOffsets.back());
+	renderThreadPool->parallelFor(count, [this, &frame](int begin, int end) {
+		for(int i = begin; i < end; i++) {
+			int segments = (ballVertexOffsets[i + 1] - ballVertexOffsets[i]) / 3;
+			const std::vector<sf::Vector2f>& points = circlePoints[segments];
+			sf::Vector2f center((float)frame.x[i], (float)frame.y[i]);
+			float radius = (float)frame.radius[i];
+			sf::Color color = frame.color[i];
+			sf::Vertex* vertex = &ballVertices[ballVertexOffsets[i]];
+			for(int j = 0; j < segments; j++) {
+				vertex[0] = sf::Vertex(center, color);
+				vertex[1] = sf::Vertex(sf::Vector2f(center.x + points[j].x * radius, center.y + points[j].y * radius), color);
+				vertex[2] = sf::Vertex(sf::Vector2f(center.x + points[j + 1].x * radius, center.y + points[j + 1].y * radius), color);
+				vertex += 3;
+			}
+		}
+	});
+	mainWindow.draw(ballVertices);
+}
+
+void Simulation::drawSprings(const Frame& frame) {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_DRAW_SPRINGS);
+	if(!frame.springsEnabled) return;
+	// Every spring goes into one line list
+	const std::vector<int>& edges = frame.springEdges;
+	springVertices.resize(edges.size());
+	renderThreadPool->parallelFor((int)edges.size() / 2, [this, &frame, &edges](int begin, int end) {
+		for(int edge = begin; edge < end; edge++) {
+			int i = edges[edge * 2];
+			int j = edges[edge * 2 + 1];
+			double deltaX = frame.x[j] - frame.x[i];
+			double deltaY = frame.y[j] - frame.y[i];
+			double distance = sqrt(deltaX*deltaX + deltaY*deltaY);
+			int opacity = 0;
+			if(distance <= frame.springMaxDistance) {
+				opacity = std::min((int)(255 - 255 * distance / frame.springMaxDistance), 255);
+			}
+			springVertices[edge * 2] = sf::Vertex(sf::Vector2f((float)frame.x[i], (float)frame.y[i]), springColors[opacity]);
+			springVertices[edge * 2 + 1] = sf::Vertex(sf::Vector2f((float)frame.x[j], (float)frame.y[j]), springColors[opacity]);
+		}
+	});
+	mainWindow.draw(springVertices);
 }
 
-void Simulation::drawUIText() {
+void Simulation::drawUIText(const Frame& frame) {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_DRAW_UI);
 
 	textDrawOffset = 0;
 	currentFontSize = FONT_SIZE_NORMAL;
 	currentTextColor = {255, 255, 0};
 
 	drawText(0, 0,				  WINDOW_SNAP_H_LEFT | WINDOW_SNAP_V_TOP, "fps: "  + std::to_string(fps));
-	drawText(0, FONT_SIZE_NORMAL, WINDOW_SNAP_H_LEFT,					  "time: " + utils::toString(time, 1));
-	std::string str = "Objects: " + std::to_string(objects.size());
+	drawText(0, FONT_SIZE_NORMAL, WINDOW_SNAP_H_LEFT,					  "time: " + utils::toString(frame.time, 1));
+	if(threadedPhysics && !replay) {
+		drawText(0, FONT_SIZE_NORMAL * 2, WINDOW_SNAP_H_LEFT,			  "steps/s: " + std::to_string(frame.stepsPerSecond));
+	}
+	std::string str = "Objects: " + std::to_string(frame.x.size());
 	drawText(0, 0,				  WINDOW_SNAP_H_CENTER | WINDOW_SNAP_V_TOP, str);
+	switch(physicsBackend) {
+		case PHYSICS_BACKEND_BULLET: str = "bullet"; break;
+		case PHYSICS_BACKEND_CIRCLE: str = "circle"; break;
+		default:					 str = "?";		 break;
+	}
+	if(replay) {
+		str = "replay";
+	}
+	drawText(0, FONT_SIZE_NORMAL, WINDOW_SNAP_H_CENTER,					  "Backend: " + str);
 
-	switch(collisionType) {
+	switch(frame.collisionType) {
 		case COLLISION_TYPE_BOUNCE: str = "bounce"; break;
 		case COLLISION_TYPE_MERGE:  str = "merge";	break;
 		default:					str = "?";		break;
 	}
-	drawOption("Collisions(" + str + ") (1)", &collisionsEnabled);
-	drawOption("Gravity radial (2)", &gravityRadialEnabled);
-	drawOption("Gravity vertical (3)", &gravityVerticalEnabled);
-	drawOption("Background friction (4)", &backgroundFrictionEnabled);
-	drawOption("Springs (5)", &springsEnabled);
+	drawOption("Collisions(" + str + ") (1)", frame.collisionsEnabled);
+	switch(frame.gravityMode) {
+		case GRAVITY_MODE_PAIRWISE:   str = "pairwise";	  break;
+		case GRAVITY_MODE_BARNES_HUT: str = "barnes-hut"; break;
+		case GRAVITY_MODE_DIRECT:	  str = std::string("direct-") + gravitykernel::getKernelName(gravityKernel); break;
+		default:					  str = "?";		  break;
+	}
+	drawOption("Gravity radial(" + str + ") (2)", frame.gravityRadialEnabled);
+	drawOption("Gravity vertical (3)", frame.gravityVerticalEnabled);
+	drawOption("Background friction (4)", frame.backgroundFrictionEnabled);
+	drawOption("Springs (5)", frame.springsEnabled);
 	drawBlank();
 
 	currentTextColor = {255, 255, 0};
-	drawInfo("Simulation speed: " + std::to_string(simulationSpeed) + " (" + std::to_string((int)simulationSpeedExponent) + ")");
+	drawInfo("Simulation speed: " + std::to_string(frame.simulationSpeed) + " (" + std::to_string(frame.simulationSpeedExponent) + ")");
 	drawBlank();
 
 	currentFontSize = FONT_SIZE_SMALL;
-	drawInfo("RadialG: ", &gravityRadialForce);
-	drawInfo("VerticalG: ", &gravityVerticalForce);
-	drawInfo("DefRest: ", &defaultRestitution);
+	drawInfo("RadialG: ", frame.gravityRadialForce);
+	drawInfo("BHTheta: ", frame.barnesHutTheta);
+	drawInfo("VerticalG: ", frame.gravityVerticalForce);
+	drawInfo("DefRest: " + std::to_string(frame.restitution));
+	if(!replay) {
+		if(frame.droppedSubSteps > 0) {
+			currentTextColor = {255, 0, 0};
+		}
+		drawInfo("Substeps: " + std::to_string(frame.subSteps) + " (dropped " + std::to_string(frame.droppedSubSteps) + ")");
+		currentTextColor = {255, 255, 0};
+	}
+	if(frame.sleepingObjects >= 0) {
+		drawInfo("Sleeping: " + std::to_string(frame.sleepingObjects));
+	}
+	if(replay) {
+		drawInfo("Frame " + std::to_string(replayFrame + 1) + " / " + std::to_string(replayReader.getFrameCount()));
+	}
+	if(frame.recordedFrames >= 0) {
+		drawInfo("Recording frame " + std::to_string(frame.recordedFrames) + " (R)");
+	}
+
+#ifdef PHYSBOX_PROFILING
+	drawProfilerPanel();
+#endif
 
-	if(pause) {
+	if(frame.pause) {
 		currentFontSize = FONT_SIZE_BIG;
 		drawText(0, 0, WINDOW_SNAP_H_CENTER | WINDOW_SNAP_V_CENTER, "PAUSE");
 	}
 
 }
 
-void Simulation::drawOption(std::string text, bool* option) {
-	currentTextColor = getBoolColor(*option);
+#ifdef PHYSBOX_PROFILING
+void Simulation::drawProfilerPanel() {
+	// Below fps and time on the left, milliseconds per frame
+	currentFontSize = FONT_SIZE_SMALL;
+	currentTextColor = {255, 255, 0};
+	int y = FONT_SIZE_NORMAL * 3;
+	drawText(0, y, WINDOW_SNAP_H_LEFT, "phase: min / avg / p99 ms");
+	for(int phase = 0; phase < PROFILE_PHASES_NUM; phase++) {
+		y += FONT_SIZE_SMALL;
+		Profiler::Stats stats = profiler.getStats((ProfilePhase)phase);
+		drawText(0, y, WINDOW_SNAP_H_LEFT, std::string(Profiler::getPhaseName((ProfilePhase)phase)) + ": "
+			+ utils::toString(stats.min, 2) + " / " + utils::toString(stats.avg, 2) + " / " + utils::toString(stats.p99, 2));
+	}
+}
+#endif
+
+void Simulation::drawOption(std::string text, bool option) {
+	currentTextColor = getBoolColor(option);
 	drawText(0, textDrawOffset, WINDOW_SNAP_H_RIGHT, text);
 	textDrawOffset += currentFontSize;
 }
@@ -175,8 +573,8 @@ void Simulation::drawInfo(std::string text) {
 	textDrawOffset += currentFontSize;
 }
 
-void Simulation::drawInfo(std::string text, double* parameter) {
-	drawInfo(text + std::to_string(*parameter));
+void Simulation::drawInfo(std::string text, double parameter) {
+	drawInfo(text + std::to_string(parameter));
 }
 
 void Simulation::drawBlank() {
@@ -185,11 +583,12 @@ void Simulation::drawBlank() {
 
 
 void Simulation::handleEvents() {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_EVENTS);
 	sf::Event event;
 	while(mainWindow.pollEvent(event)) {
 		switch(event.type) {
 
-			case sf::Event::Closed:					exit(EXIT_SUCCESS);			break;
+			case sf::Event::Closed:					quit();					break;
 
 			case sf::Event::KeyPressed:
 			case sf::Event::KeyReleased:			handleKeyboard(event);		break;
@@ -204,25 +603,68 @@ void Simulation::handleEvents() {
 }
 
 void Simulation::handleKeyboard(sf::Event event) {
+	if(replay) {
+		handleReplayKeyboard(event);
+		return;
+	}
+	if(event.type == sf::Event::KeyPressed) {
+		sf::Keyboard::Key key = event.key.code;
+		switch(key) {
+			case sf::Keyboard::Escape:		quit();													break;
+			case sf::Keyboard::F2:			uiEnabled = !uiEnabled;									break;
+			// Everything else changes the simulation and goes to the physics thread
+			default:						post([this, key] { handleSimulationKey(key); });		break;
+		}
+	}
+}
+
+void Simulation::handleSimulationKey(sf::Keyboard::Key key) {
+	switch(key) {
+		case sf::Keyboard::Space:		pause = !pause;											break;
+		case sf::Keyboard::Num1:		collisionsEnabled = !collisionsEnabled;					break;
+		case sf::Keyboard::Num2:		gravityRadialEnabled = !gravityRadialEnabled;			break;
+		case sf::Keyboard::Num3:		gravityVerticalEnabled = !gravityVerticalEnabled;		break;
+		case sf::Keyboard::Num4:		backgroundFrictionEnabled = !backgroundFrictionEnabled; break;
+		case sf::Keyboard::Num5:		springsEnabled = !springsEnabled;						break;
+		case sf::Keyboard::Add:			changeSimulationSpeed(1);								break;
+		case sf::Keyboard::Subtract:	changeSimulationSpeed(-1);								break;
+		case sf::Keyboard::F5:			saveSnapshot(snapshotFile);								break;
+		case sf::Keyboard::F9:			loadSnapshot(snapshotFile);								break;
+		case sf::Keyboard::C:			nextCollisionType();									break;
+		case sf::Keyboard::G:			nextGravityMode();										break;
+		case sf::Keyboard::R:			toggleRecording();										break;
+		case sf::Keyboard::Up:			bumpAll(0, -bumpSpeed);									break;
+		case sf::Keyboard::Down:		bumpAll(0,  bumpSpeed);									break;
+		case sf::Keyboard::Left:		bumpAll(-bumpSpeed, 0);									break;
+		case sf::Keyboard::Right:		bumpAll( bumpSpeed, 0);									break;
+		case sf::Keyboard::LBracket:	gravityRadialForce -= gravityIncrement;					break;
+		case sf::Keyboard::RBracket:	gravityRadialForce += gravityIncrement;					break;
+	}
+	// Resting bodies were balanced under the old forces
+	switch(key) {
+		case sf::Keyboard::Num1:
+		case sf::Keyboard::Num2:
+		case sf::Keyboard::Num3:
+		case sf::Keyboard::Num5:
+		case sf::Keyboard::C:
+		case sf::Keyboard::LBracket:
+		case sf::Keyboard::RBracket:	wakeAll();												break;
+	}
+}
+
+void Simulation::handleReplayKeyboard(sf::Event event) {
 	if(event.type == sf::Event::KeyPressed) {
 		switch(event.key.code) {
-			case sf::Keyboard::Escape:		exit(EXIT_SUCCESS);										break;
+			case sf::Keyboard::Escape:		quit();													break;
 			case sf::Keyboard::Space:		pause = !pause;											break;
-			case sf::Keyboard::Num1:		collisionsEnabled = !collisionsEnabled;					break;
-			case sf::Keyboard::Num2:		gravityRadialEnabled = !gravityRadialEnabled;			break;
-			case sf::Keyboard::Num3:		gravityVerticalEnabled = !gravityVerticalEnabled;		break;
-			case sf::Keyboard::Num4:		backgroundFrictionEnabled = !backgroundFrictionEnabled; break;
 			case sf::Keyboard::Num5:		springsEnabled = !springsEnabled;						break;
 			case sf::Keyboard::Add:			changeSimulationSpeed(1);								break;
 			case sf::Keyboard::Subtract:	changeSimulationSpeed(-1);								break;
 			case sf::Keyboard::F2:			uiEnabled = !uiEnabled;									break;
-			case sf::Keyboard::C:			nextCollisionType();									break;
-			case sf::Keyboard::Up:			bumpAll(0, -bumpSpeed);									break;
-			case sf::Keyboard::Down:		bumpAll(0,  bumpSpeed);									break;
-			case sf::Keyboard::Left:		bumpAll(-bumpSpeed, 0);									break;
-			case sf::Keyboard::Right:		bumpAll( bumpSpeed, 0);									break;
-			case sf::Keyboard::LBracket:	gravityRadialForce -= gravityIncrement;					break;
-			case sf::Keyboard::RBracket:	gravityRadialForce += gravityIncrement;					break;
+			case sf::Keyboard::Left:		seekReplay(replayFrame - REPLAY_SEEK_FRAMES);			break;
+			case sf::Keyboard::Right:		seekReplay(replayFrame + REPLAY_SEEK_FRAMES);			break;
+			case sf::Keyboard::Home:		seekReplay(0);											break;
+			case sf::Keyboard::End:			seekReplay(replayReader.getFrameCount() - 1);			break;
 		}
 	}
 }
@@ -256,71 +698,284 @@ void Simulation::handleMouse(sf::Event event) {
 
 void Simulation::processPhysics() {
 	if(pause) return;
-	deleteMarked();
+	{
+		PROFILE_SCOPE(profiler, PROFILE_PHASE_PHYSICS);
+		deleteMarked();
+		if(gravityVerticalEnabled) {
+			physicsWorld->setGravity(0, gravityVerticalForce);
+		} else {
+			physicsWorld->setGravity(0, 0);
+		}
+		// New springs once per frame, substeps only move the objects a little further
+		formSprings();
+		{
+			// Includes the force passes, they run in the tick callback before every fixed substep
+			PROFILE_SCOPE(profiler, PROFILE_PHASE_STEP);
+			// Time dropped by the scheduler is not added, so time matches what was simulated
+			time += stepScheduler.advance(physicsWorld, simulationSpeed * SECONDS_PER_FRAME);
+		}
+		readParticles();
+		processMerges();
+		deleteMarked();
+		if(recorder.isRecording()) {
+			recordFrame();
+		}
+	}
+	PROFILE_END_FRAME(profiler, PROFILE_GROUP_PHYSICS);
+}
+
+void Simulation::processForces(double delta) {
+	readParticles();
 	processGravity();
 	processSprings();
-	if(gravityVerticalEnabled) {
-		dynamicsWorld->setGravity(btVector3(0, gravityVerticalForce, 0));
-	} else {
-		dynamicsWorld->setGravity(btVector3(0, 0, 0));
+	applyForces(delta);
+	writeParticles();
+}
+
+bool Simulation::isMergeEnabled() {
+	return collisionsEnabled && collisionType == COLLISION_TYPE_MERGE;
+}
+
+void Simulation::processMerges() {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_MERGES);
+	if(!isMergeEnabled()) {
+		touchingPairs.clear();
+		return;
+	}
+	physicsWorld->getTouchingPairs(touchingPairs);
+	// Touching balls are joined into groups first, so chains where A absorbs B which
+	// absorbed C end up in one ball within the same step
+	mergeGroups.resize(objects.size());
+	for(int i = 0; i < (int)objects.size(); i++) {
+		mergeGroups[i] = i;
+	}
+	for(const PhysicsWorld::BodyPair& pair: touchingPairs) {
+		SimObject* object1 = (SimObject*)pair.first->getUserPointer();
+		SimObject* object2 = (SimObject*)pair.second->getUserPointer();
+		if(!object1 || !object2) continue;
+		if(object1->getObjectType() != OBJECT_TYPE_BALL || object2->getObjectType() != OBJECT_TYPE_BALL) continue;
+		// Static balls have infinite mass, the mass weighted merge would turn everything into NaN
+		if(particles.invMass[object1->index] == 0 || particles.invMass[object2->index] == 0) continue;
+		int group1 = findMergeGroup(object1->index);
+		int group2 = findMergeGroup(object2->index);
+		if(group1 == group2) continue;
+		// Root of a group is its heaviest ball, the rest merge into it
+		if(objects[group1]->getMass() < objects[group2]->getMass()) {
+			std::swap(group1, group2);
+		}
+		mergeGroups[group2] = group1;
+	}
+	touchingPairs.clear();
+	for(int i = 0; i < (int)objects.size(); i++) {
+		int group = findMergeGroup(i);
+		if(group != i) {
+			Ball::mergeBalls((Ball*)objects[group], (Ball*)objects[i], simulationSpeed);
+		}
 	}
+}
+
+int Simulation::findMergeGroup(int object) {
+	while(mergeGroups[object] != object) {
+		mergeGroups[object] = mergeGroups[mergeGroups[object]];
+		object = mergeGroups[object];
+	}
+	return object;
+}
+
+void Simulation::readParticles() {
 	for(SimObject* object: objects) {
-		object->setRestitution(defaultRestitution);
-		object->setFriction(defaultFriction);
+		object->pullFromRigidBody();
 	}
-	for(Plane* plane: planes) {
-		plane->setRestitution(defaultRestitution);
-		plane->setFriction(defaultFriction);
+}
+
+void Simulation::writeParticles() {
+	for(SimObject* object: objects) {
+		// Nothing changed the velocity of a sleeping body
+		if(particles.awake[object->index]) {
+			object->pushToRigidBody();
+		}
 	}
-	dynamicsWorld->stepSimulation(simulationSpeed * SECONDS_PER_FRAME, 100);
-	time += simulationSpeed * SECONDS_PER_FRAME;
 }
 
 void Simulation::deleteMarked() {
-	int i = 0;
-	while(i < (int)objects.size()) {
-		if(objects.at(i)->isMarkedForDeletion) {
-			deleteObject(objects.at(i));
-		} else {
-			i++;
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_DELETE);
+	bool anyMarked = false;
+	for(SimObject* object: objects) {
+		if(object->isMarkedForDeletion) {
+			anyMarked = true;
+			break;
 		}
 	}
+	if(!anyMarked) return;
+	// One stable pass over objects and the store, survivors keep their order
+	remapIndex.resize(objects.size());
+	int count = 0;
+	for(int i = 0; i < (int)objects.size(); i++) {
+		SimObject* object = objects[i];
+		if(object->isMarkedForDeletion) {
+			object->removeFromRigidBodyWorld(physicsWorld);
+			ballPool.destroy((Ball*)object);
+			remapIndex[i] = -1;
+			continue;
+		}
+		objects[count] = object;
+		particles.move(i, count);
+		object->index = count;
+		remapIndex[i] = count;
+		count++;
+	}
+	objects.resize(count);
+	particles.resize(count);
+	// Springs touching deleted objects go with them
+	springGraph.remap(remapIndex, count);
 }
 
 void Simulation::processGravity() {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_GRAVITY);
 	if(gravityRadialEnabled) {
-		for(SimObject* object1: objects) {
+		gravitySubSteps = (gravitySubSteps + 1) % SLEEPING_GRAVITY_INTERVAL;
+		sleepingGravityDue = gravitySubSteps == 0;
+		// A settled scene needs no tree or masses between the sleeping evaluations
+		bool anyTarget = sleepingGravityDue || std::find(particles.awake.begin(), particles.awake.end(), 1) != particles.awake.end();
+		if(anyTarget) {
+			switch(gravityMode) {
+				case GRAVITY_MODE_PAIRWISE:		processGravityPairwise();	break;
+				case GRAVITY_MODE_BARNES_HUT:	processGravityBarnesHut();	break;
+				case GRAVITY_MODE_DIRECT:		processGravityDirect();		break;
+			}
+		}
+		// Forces are still empty before gravity, so they hold just the gravity of this substep.
+		// Bodies left out this time reuse their last one.
+		for(int i = 0; i < particles.size(); i++) {
+			if(isGravityTarget(i)) {
+				particles.gravityX[i] = particles.forceX[i];
+				particles.gravityY[i] = particles.forceY[i];
+			} else {
+				particles.forceX[i] = particles.gravityX[i];
+				particles.forceY[i] = particles.gravityY[i];
+			}
+		}
+	}
+}
+
+bool Simulation::isGravityTarget(int i) {
+	return particles.awake[i] || sleepingGravityDue;
+}
+
+void Simulation::processGravityPairwise() {
+	threadPool->parallelFor((int)objects.size(), [this](int begin, int end) {
+		for(int i = begin; i < end; i++) {
+			// Sleeping bodies still pull the others every substep
+			if(!isGravityTarget(i)) continue;
+			SimObject* object1 = objects[i];
 			for(SimObject* object2: objects) {
 				if(object1 == object2) continue;
-				object1->calculateGravity(object2, simulationSpeed, gravityRadialForce);
+				object1->calculateGravity(object2, gravityRadialForce);
 			}
 		}
+	});
+}
+
+void Simulation::processGravityBarnesHut() {
+	gravityMass.resize(particles.size());
+	for(int i = 0; i < particles.size(); i++) {
+		gravityMass[i] = 1.0 / particles.invMass[i];
 	}
+	gravityTree.build(particles.x, particles.y, gravityMass);
+	threadPool->parallelFor(particles.size(), [this](int begin, int end) {
+		for(int i = begin; i < end; i++) {
+			if(!isGravityTarget(i)) continue;
+			double accX, accY;
+			gravityTree.calculateAcceleration(i, barnesHutTheta, accX, accY);
+			particles.forceX[i] += accX * gravityRadialForce * gravityMass[i];
+			particles.forceY[i] += accY * gravityRadialForce * gravityMass[i];
+		}
+	});
 }
 
-void Simulation::processSprings() {
+void Simulation::processGravityDirect() {
+	gravityMass.resize(particles.size());
+	for(int i = 0; i < particles.size(); i++) {
+		gravityMass[i] = 1.0 / particles.invMass[i];
+	}
+	threadPool->parallelFor(particles.size(), [this](int begin, int end) {
+		// The kernel takes a contiguous range of targets, so hand it the runs of them
+		int runBegin = begin;
+		while(runBegin < end) {
+			while(runBegin < end && !isGravityTarget(runBegin)) runBegin++;
+			int runEnd = runBegin;
+			while(runEnd < end && isGravityTarget(runEnd)) runEnd++;
+			if(runEnd > runBegin) {
+				gravitykernel::accumulateForces(gravityKernel, particles.x.data(), particles.y.data(), gravityMass.data(),
+					particles.size(), runBegin, runEnd, gravityRadialForce, particles.forceX.data(), particles.forceY.data());
+			}
+			runBegin = runEnd;
+		}
+	});
+}
+
+void Simulation::formSprings() {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_SPRINGS);
 	if(springsEnabled) {
-		for(SimObject* object1: objects) {
-			if(object1->springConnections.size() >= springMaxConnections) continue;
-			for(SimObject* object2: objects) {
-				if(object1 == object2) continue;
-				if(!object1->isActive && !object2->isActive) continue;
-				if(object1->springConnections.size() >= springMaxConnections) break;
-				if(object2->incomingSpringConnectionsCount >= springMaxConnections) continue;
-				if(std::find(object1->springConnections.begin(), object1->springConnections.end(),
-					object2) != object1->springConnections.end()) continue;
-				if((springDistance > 0) && (SimObject::distanceBetween(object1, object2) < springDistance)) {
-					object1->springConnections.push_back(object2);
-					object2->incomingSpringConnectionsCount++;
-				}
+		springGraph.setObjectCount((int)objects.size());
+		// Existing springs have to be in CSR order for contains()
+		springGraph.sort();
+		if(springDistance > 0) {
+			// Springs only form closer than springDistance, so only neighboring cells can connect
+			springGrid.build(particles.x, particles.y, springDistance);
+			for(int i = 0; i < (int)objects.size(); i++) {
+				if(springGraph.getOutgoingCount(i) >= springMaxConnections) continue;
+				springGrid.forEachNeighbor(particles.x[i], particles.y[i], [&](int j) {
+					if(i == j) return;
+					if(!objects[i]->isActive && !objects[j]->isActive) return;
+					if(!particles.awake[i] && !particles.awake[j]) return;
+					if(springGraph.getOutgoingCount(i) >= springMaxConnections) return;
+					if(springGraph.getIncomingCount(j) >= springMaxConnections) return;
+					double deltaX = particles.x[j] - particles.x[i];
+					double deltaY = particles.y[j] - particles.y[i];
+					if(deltaX*deltaX + deltaY*deltaY >= springDistance*springDistance) return;
+					if(springGraph.contains(i, j)) return;
+					springGraph.add(i, j, springDistance);
+				});
 			}
+			springGraph.sort();
 		}
-		for(SimObject* object: objects) {
-			for(int j = object->springConnections.size() - 1; j >= 0; j--) {
-				object->calculateSprings(object->springConnections.at(j),
-					simulationSpeed, springMaxDistance, springDistance, springDamping, springForce);
+	}
+}
+
+void Simulation::processSprings() {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_SPRINGS);
+	if(springsEnabled) {
+		// Every spring on its own first, then each object sums its springs, so no two threads write the same force
+		threadPool->parallelFor(springGraph.size(), [this](int begin, int end) {
+			springGraph.calculateForces(particles, begin, end, springForce, springDamping, springMaxDistance);
+		});
+		threadPool->parallelFor((int)objects.size(), [this](int begin, int end) {
+			springGraph.applyForces(particles, begin, end);
+		});
+		springGraph.removeBroken();
+	}
+}
+
+void Simulation::applyForces(double delta) {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_APPLY_FORCES);
+	for(int i = 0; i < particles.size(); i++) {
+		// Static balls have infinite mass, forces on them would turn into 0 * inf
+		if(particles.invMass[i] != 0) {
+			double forceX = particles.forceX[i];
+			double forceY = particles.forceY[i];
+			if(particles.awake[i]) {
+				particles.restForceX[i] = forceX;
+				particles.restForceY[i] = forceY;
+			} else {
+				// Contacts held the body against the load it fell asleep under, only a change in it counts
+				forceX -= particles.restForceX[i];
+				forceY -= particles.restForceY[i];
 			}
+			addVelocity(i, forceX * particles.invMass[i] * delta, forceY * particles.invMass[i] * delta);
 		}
+		particles.forceX[i] = 0;
+		particles.forceY[i] = 0;
 	}
 }
 
@@ -370,17 +1025,54 @@ void Simulation::updateFpsCount() {
 	}
 }
 
+void Simulation::updateStepCount() {
+	if(stepClock.getElapsedTime().asMilliseconds() > 1000) {
+		stepsPerSecond = stepCount;
+		stepCount = 0;
+		stepClock.restart();
+	}
+}
+
 Ball* Simulation::addBall(double x, double y, double radius, double speedX, double speedY, sf::Color color, bool isActive) {
-	Ball* ball = new Ball(x, y, radius, speedX, speedY, color, isActive);
+	BallParameters parameters = { x, y, radius, speedX, speedY, color, isActive };
+	Ball* ball = createBall(parameters);
+	ball->addToRigidBodyWorld(physicsWorld);
+	return ball;
+}
+
+int Simulation::addBalls(const std::vector<BallParameters>& balls) {
+	int first = (int)objects.size();
+	int count = (int)balls.size();
+	objects.reserve(first + count);
+	particles.reserve(first + count);
+	std::vector<btRigidBody*> bodies;
+	bodies.reserve(count);
+	for(const BallParameters& parameters: balls) {
+		bodies.push_back(createBall(parameters)->getRigidBody());
+	}
+	physicsWorld->addRigidBodies(bodies);
+	return first;
+}
+
+Ball* Simulation::createBall(const BallParameters& parameters) {
+	Ball* ball = ballPool.create(&particles, &shapeCache, parameters.x, parameters.y, parameters.radius,
+		parameters.speedX, parameters.speedY, parameters.color, parameters.isActive);
+	ball->setMaterial(&defaultMaterial);
+	if(sleepEnabled) {
+		ball->allowSleeping(sleepLinearThreshold, sleepAngularThreshold);
+	}
 	objects.push_back(ball);
-	ball->addToRigidBodyWorld(dynamicsWorld);
 	return ball;
 }
 
 Plane* Simulation::addPlane(Plane::PlaneSide side) {
-	Plane* plane = new Plane(side);
+	Plane* plane = new Plane(side, worldWidth, worldHeight);
+	plane->setMaterial(&wallMaterial);
+	if(sleepEnabled) {
+		plane->allowSleeping(sleepLinearThreshold, sleepAngularThreshold);
+	}
 	planes.push_back(plane);
-	plane->addToRigidBodyWorld(dynamicsWorld);
+	plane->addToRigidBodyWorld(physicsWorld);
 	return plane;
 }
 
@@ -393,17 +1085,72 @@ void Simulation::nextCollisionType() {
 	collisionType = (CollisionType)((collisionType+1) % COLLISION_TYPES_NUM);	
 }
 
+void Simulation::nextGravityMode() {
+	gravityMode = (GravityMode)((gravityMode+1) % GRAVITY_MODES_NUM);
+}
+
+void Simulation::toggleRecording() {
+	if(recorder.isRecording()) {
+		recorder.stop();
+	} else {
+		recorder.start(recordFile, recordPrecision, recordPrecision, recordKeyframeInterval);
+	}
+}
+
+void Simulation::recordFrame() {
+	PROFILE_SCOPE(profiler, PROFILE_PHASE_RECORD);
+	collectSpringEdges();
+	recorder.recordFrame(time, particles, springEdges);
+}
+
+void Simulation::collectSpringEdges() {
+	springEdges.resize(springGraph.size() * 2);
+	for(int edge = 0; edge < springGraph.size(); edge++) {
+		springEdges[edge * 2] = springGraph.from[edge];
+		springEdges[edge * 2 + 1] = springGraph.to[edge];
+	}
+}
+
 void Simulation::checkExitCondition() {
 	if(exitContidionFunction(this))
 		exitRequest = true;
 }
 
+void Simulation::addVelocity(int i, double deltaVelX, double deltaVelY) {
+	if(!particles.awake[i]) {
+		// Small changes add up while the body sleeps, a lasting one wakes it eventually
+		particles.pendingVelX[i] += deltaVelX;
+		particles.pendingVelY[i] += deltaVelY;
+		double pendingX = particles.pendingVelX[i];
+		double pendingY = particles.pendingVelY[i];
+		if(pendingX*pendingX + pendingY*pendingY < sleepLinearThreshold*sleepLinearThreshold) return;
+		// The sum only decides when to wake, applying it would kick the body
+		objects[i]->wake();
+		particles.pendingVelX[i] = 0;
+		particles.pendingVelY[i] = 0;
+	}
+	particles.velX[i] += deltaVelX;
+	particles.velY[i] += deltaVelY;
+}
+
+void Simulation::wakeAll() {
+	for(SimObject* object: objects) {
+		object->wake();
+	}
+}
+
 void Simulation::bumpAll(double velX, double velY) {
-	for(SimObject* obj: objects) {
-		obj->setVelX(obj->getVelX() + velX);
-		obj->setVelY(obj->getVelY() + velY);
+	for(int i = 0; i < particles.size(); i++) {
+		addVelocity(i, velX, velY);
 	}
+	writeParticles();
+}
+
+#ifdef PHYSBOX_PROFILING
+Profiler& Simulation::getProfiler() {
+	return profiler;
 }
+#endif
 
 void Simulation::resetSimulation() {
 	exitRequest = false;
@@ -413,29 +1160,228 @@ void Simulation::resetSimulation() {
 
 
 void Simulation::deleteAllObjects() {
-	for(SimObject* object: objects)
-		delete object;
+	// Replacing the world is much cheaper than removing every body from it
+	delete physicsWorld;
+	physicsWorld = nullptr;
+	touchingPairs.clear();
+	for(SimObject* object: objects) {
+		ballPool.destroy((Ball*)object);
+	}
 	objects.clear();
+	particles.clear();
+	springGraph.clear();
+	shapeCache.clear();
+	for(Plane* plane: planes) {
+		delete plane;
+	}
+	planes.clear();
+	initPhysics();
 }
 
 void Simulation::deleteObject(SimObject* object) {
-	delete object;
-	objects.erase(std::remove(objects.begin(), objects.end(), object), objects.end());
+	object->isMarkedForDeletion = true;
+	deleteMarked();
 }
 
 void Simulation::generateSystem(double centerX, double centerY, double centerRadius, double moonRadius, int moonCount, double gap) {
 	Ball* center = addBall(centerX, centerY, centerRadius, 0, 0, { 255, 255, 0 });
+	std::vector<BallParameters> moons(moonCount);
 	for(int i = 1; i <= moonCount; i++) {
 		double angle = utils::randomBetween(0, 360);
 		double distanceToCenter = i * gap;
 		double velocity = sqrt(gravityRadialForce * center->getMass() / distanceToCenter);
-		addBall(
-			cos(angle * PI / 180) * distanceToCenter + centerX,
-			sin(angle * PI / 180) * distanceToCenter + centerY,
-			moonRadius,
-			cos((angle + 90) * PI / 180) * velocity,
-			sin((angle + 90) * PI / 180) * velocity,
-			utils::randomColor()
-		);
+		BallParameters& moon = moons[i - 1];
+		moon.x = cos(angle * PI / 180) * distanceToCenter + centerX;
+		moon.y = sin(angle * PI / 180) * distanceToCenter + centerY;
+		moon.radius = moonRadius;
+		moon.speedX = cos((angle + 90) * PI / 180) * velocity;
+		moon.speedY = sin((angle + 90) * PI / 180) * velocity;
+		moon.color = utils::randomColor();
+		moon.isActive = true;
 	}
+	addBalls(moons);
 }
+
+bool Simulation::saveSnapshot(std::string path) {
+	snapshot::Header header = {};
+	header.magic = snapshot::MAGIC;
+	header.version = snapshot::VERSION;
+	header.objectCount = (uint32_t)objects.size();
+	header.planeCount = (uint32_t)planes.size();
+	if(collisionsEnabled)			header.flags |= snapshot::FLAG_COLLISIONS;
+	if(gravityRadialEnabled)		header.flags |= snapshot::FLAG_GRAVITY_RADIAL;
+	if(gravityVerticalEnabled)		header.flags |= snapshot::FLAG_GRAVITY_VERTICAL;
+	if(backgroundFrictionEnabled)	header.flags |= snapshot::FLAG_BACKGROUND_FRICTION;
+	if(springsEnabled)				header.flags |= snapshot::FLAG_SPRINGS;
+	header.collisionType = collisionType;
+	header.gravityMode = gravityMode;
+	header.simulationSpeedExponent = simulationSpeedExponent;
+	header.time = time;
+	header.worldWidth = worldWidth;
+	header.worldHeight = worldHeight;
+	header.gravityVerticalForce = gravityVerticalForce;
+	header.gravityRadialForce = gravityRadialForce;
+	header.barnesHutTheta = barnesHutTheta;
+	header.springForce = springForce;
+	header.springDamping = springDamping;
+	header.springDistance = springDistance;
+	header.springMaxDistance = springMaxDistance;
+	header.backgroundFrictionForce = backgroundFrictionForce;
+	header.restitution = defaultMaterial.getRestitution();
+	header.friction = defaultMaterial.getFriction();
+	header.wallRestitution = wallMaterial.getRestitution();
+	header.wallFriction = wallMaterial.getFriction();
+	std::vector<uint32_t> springs(springGraph.size() * 2);
+	for(int edge = 0; edge < springGraph.size(); edge++) {
+		springs[edge * 2] = springGraph.from[edge];
+		springs[edge * 2 + 1] = springGraph.to[edge];
+	}
+	header.springCount = (uint32_t)(springs.size() / 2);
+	snapshot::Layout layout = snapshot::getLayout(header);
+	std::vector<char> data(layout.size, 0);
+	int count = (int)objects.size();
+	memcpy(&data[0], &header, sizeof(header));
+	memcpy(&data[layout.x], particles.x.data(), count * sizeof(double));
+	memcpy(&data[layout.y], particles.y.data(), count * sizeof(double));
+	memcpy(&data[layout.velX], particles.velX.data(), count * sizeof(double));
+	memcpy(&data[layout.velY], particles.velY.data(), count * sizeof(double));
+	memcpy(&data[layout.radius], particles.radius.data(), count * sizeof(double));
+	double* mass = (double*)&data[layout.mass];
+	double* angVel = (double*)&data[layout.angVel];
+	double* rotation = (double*)&data[layout.rotation];
+	double* deactivationTime = (double*)&data[layout.deactivationTime];
+	unsigned char* color = (unsigned char*)&data[layout.color];
+	for(int i = 0; i < count; i++) {
+		mass[i] = particles.invMass[i] > 0 ? 1.0 / particles.invMass[i] : 0;
+		btRigidBody* body = objects[i]->getRigidBody();
+		const btVector3& angularVelocity = body->getAngularVelocity();
+		angVel[i * 3] = angularVelocity.x();
+		angVel[i * 3 + 1] = angularVelocity.y();
+		angVel[i * 3 + 2] = angularVelocity.z();
+		btQuaternion orientation = body->getWorldTransform().getRotation();
+		rotation[i * 4] = orientation.x();
+		rotation[i * 4 + 1] = orientation.y();
+		rotation[i * 4 + 2] = orientation.z();
+		rotation[i * 4 + 3] = orientation.w();
+		deactivationTime[i] = body->getDeactivationTime();
+		data[layout.activation + i] = (char)body->getActivationState();
+		color[i * 4] = particles.color[i].r;
+		color[i * 4 + 1] = particles.color[i].g;
+		color[i * 4 + 2] = particles.color[i].b;
+		color[i * 4 + 3] = particles.color[i].a;
+		data[layout.active + i] = objects[i]->isActive ? 1 : 0;
+	}
+	if(!springs.empty()) {
+		memcpy(&data[layout.springs], springs.data(), springs.size() * sizeof(uint32_t));
+	}
+	for(int i = 0; i < (int)planes.size(); i++) {
+		data[layout.planes + i] = (char)planes[i]->getSide();
+	}
+	std::ofstream file(path, std::ios::binary);
+	file.write(data.data(), data.size());
+	return (bool)file;
+}
+
+bool Simulation::loadSnapshot(std::string path) {
+	MappedFile file;
+	if(!file.open(path)) return false;
+	if(file.getSize() < sizeof(snapshot::Header)) return false;
+	snapshot::Header header;
+	memcpy(&header, file.getData(), sizeof(header));
+	if(header.magic != snapshot::MAGIC || header.version != snapshot::VERSION) return false;
+	snapshot::Layout layout = snapshot::getLayout(header);
+	if(file.getSize() < layout.size) return false;
+	const char* data = file.getData();
+	const double* x = (const double*)(data + layout.x);
+	const double* y = (const double*)(data + layout.y);
+	const double* velX = (const double*)(data + layout.velX);
+	const double* velY = (const double*)(data + layout.velY);
+	const double* mass = (const double*)(data + layout.mass);
+	const double* radius = (const double*)(data + layout.radius);
+	const double* angVel = (const double*)(data + layout.angVel);
+	const double* rotation = (const double*)(data + layout.rotation);
+	const double* deactivationTime = (const double*)(data + layout.deactivationTime);
+	const unsigned char* activation = (const unsigned char*)(data + layout.activation);
+	const unsigned char* color = (const unsigned char*)(data + layout.color);
+	const unsigned char* active = (const unsigned char*)(data + layout.active);
+	const uint32_t* springs = (const uint32_t*)(data + layout.springs);
+	const unsigned char* planeSides = (const unsigned char*)(data + layout.planes);
+	// Everything is checked before the current scene is dropped
+	if(header.collisionType < 0 || header.collisionType >= COLLISION_TYPES_NUM) return false;
+	if(header.gravityMode < 0 || header.gravityMode >= GRAVITY_MODES_NUM) return false;
+	for(size_t i = 0; i < (size_t)header.springCount * 2; i++) {
+		if(springs[i] >= header.objectCount) return false;
+	}
+	for(uint32_t i = 0; i < header.objectCount; i++) {
+		if(activation[i] < ACTIVE_TAG || activation[i] > DISABLE_SIMULATION) return false;
+	}
+	for(uint32_t i = 0; i < header.planeCount; i++) {
+		if(planeSides[i] > Plane::POS_BOTTOM) return false;
+	}
+	deleteAllObjects();
+	collisionsEnabled			= (header.flags & snapshot::FLAG_COLLISIONS) != 0;
+	gravityRadialEnabled		= (header.flags & snapshot::FLAG_GRAVITY_RADIAL) != 0;
+	gravityVerticalEnabled		= (header.flags & snapshot::FLAG_GRAVITY_VERTICAL) != 0;
+	backgroundFrictionEnabled	= (header.flags & snapshot::FLAG_BACKGROUND_FRICTION) != 0;
+	springsEnabled				= (header.flags & snapshot::FLAG_SPRINGS) != 0;
+	collisionType = (CollisionType)header.collisionType;
+	gravityMode = (GravityMode)header.gravityMode;
+	simulationSpeedExponent = header.simulationSpeedExponent;
+	changeSimulationSpeed(0);
+	time = header.time;
+	worldWidth = header.worldWidth;
+	worldHeight = header.worldHeight;
+	gravityVerticalForce = header.gravityVerticalForce;
+	gravityRadialForce = header.gravityRadialForce;
+	barnesHutTheta = header.barnesHutTheta;
+	springForce = header.springForce;
+	springDamping = header.springDamping;
+	springDistance = header.springDistance;
+	springMaxDistance = header.springMaxDistance;
+	backgroundFrictionForce = header.backgroundFrictionForce;
+	defaultMaterial.setRestitution(header.restitution);
+	defaultMaterial.setFriction(header.friction);
+	wallMaterial.setRestitution(header.wallRestitution);
+	wallMaterial.setFriction(header.wallFriction);
+	std::vector<BallParameters> balls(header.objectCount);
+	for(uint32_t i = 0; i < header.objectCount; i++) {
+		BallParameters& ball = balls[i];
+		ball.x = x[i];
+		ball.y = y[i];
+		ball.radius = radius[i];
+		ball.speedX = velX[i];
+		ball.speedY = velY[i];
+		ball.color = sf::Color(color[i * 4], color[i * 4 + 1], color[i * 4 + 2], color[i * 4 + 3]);
+		ball.isActive = active[i] != 0;
+	}
+	int first = addBalls(balls);
+	for(uint32_t i = 0; i < header.objectCount; i++) {
+		// Balls that never merged get the same mass back from their radius
+		SimObject* ball = objects[first + i];
+		if(active[i] && ball->getMass() != mass[i]) {
+			ball->setMass(mass[i]);
+		}
+		btRigidBody* body = ball->getRigidBody();
+		btTransform transform = body->getWorldTransform();
+		transform.setRotation(btQuaternion(rotation[i * 4], rotation[i * 4 + 1], rotation[i * 4 + 2], rotation[i * 4 + 3]));
+		body->setCenterOfMassTransform(transform);
+		body->getMotionState()->setWorldTransform(transform);
+		body->setAngularVelocity(btVector3(angVel[i * 3], angVel[i * 3 + 1], angVel[i * 3 + 2]));
+		// Sleep state only comes back when this run lets bodies sleep, otherwise a saved
+		// sleeping body would never wake
+		if(sleepEnabled && activation[i] != DISABLE_DEACTIVATION && activation[i] != DISABLE_SIMULATION) {
+			body->forceActivationState(activation[i]);
+			body->setDeactivationTime(deactivationTime[i]);
+			particles.awake[first + i] = body->isActive();
+		}
+	}
+	// Snapshots keep no rest lengths, every spring forms at springDistance anyway
+	springGraph.setObjectCount((int)objects.size());
+	for(uint32_t i = 0; i < header.springCount; i++) {
+		springGraph.add(springs[i * 2], springs[i * 2 + 1], springDistance);
+	}
+	for(uint32_t i = 0; i < header.planeCount; i++) {
+		addPlane((Plane::PlaneSide)planeSides[i]);
+	}
+	return true;
+}
\ No newline at end of file
@@ -11,11 +11,58 @@
 #include <libconfig.hh>
 #include <btBulletDynamicsCommon.h>
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <atomic>
 #include "globals.h"
 #include "simobject.h"
+#include "circleworld.h"
+#include "quadtree.h"
+#include "gravitykernel.h"
+#include "spatialgrid.h"
+#include "threadpool.h"
+#include "pool.h"
+#include "bulletallocator.h"
+#include "mappedfile.h"
+#include "snapshot.h"
+#include "trajectoryrecorder.h"
+#include "trajectoryreader.h"
+#include "stepscheduler.h"
+#include "springgraph.h"
+#include "profiler.h"
+#include "triplebuffer.h"
+#include "commandqueue.h"
 #include "utils.h"
 
 const double SECONDS_PER_FRAME = 1.0/60.0;
+// Balls are drawn as triangle fans with about one segment per this many pixels of circumference
+const double CIRCLE_SEGMENT_LENGTH = 4.0;
+const int MIN_CIRCLE_SEGMENTS = 6;
+const int MAX_CIRCLE_SEGMENTS = 64;
+// Exact, PI from globals.h is too coarse to close a circle
+const double FULL_TURN = 6.283185307179586;
+
+enum PhysicsBackend {
+	PHYSICS_BACKEND_BULLET,
+	PHYSICS_BACKEND_CIRCLE
+};
+
+enum GravityMode {
+	GRAVITY_MODE_PAIRWISE,
+	GRAVITY_MODE_BARNES_HUT,
+	GRAVITY_MODE_DIRECT,
+	GRAVITY_MODES_NUM
+};
+
+// One ball for Simulation::addBalls, the values addBall takes
+struct BallParameters {
+	double x, y;
+	double radius;
+	double speedX, speedY;
+	sf::Color color;
+	bool isActive;
+};
 
 class Simulation {
 
@@ -26,21 +73,70 @@ public:
 	bool gravityVerticalEnabled = false;
 	bool backgroundFrictionEnabled = false;
 	bool springsEnabled = false;
+	// Headless runs open no window, take world bounds from the config and step as fast as possible
+	bool headless = false;
+	int headlessSteps = 0;
+	// Plays replayFile back instead of simulating, no physics world is created.
+	// Needs a window, headless runs ignore it.
+	bool replay = false;
+	std::string replayFile;
+	// Steps physics on its own thread as fast as it can while the window keeps
+	// drawing the latest finished state. Headless runs and replays ignore it.
+	bool threadedPhysics = false;
+	double worldWidth = 1920;
+	double worldHeight = 1080;
 
 	CollisionType collisionType = COLLISION_TYPE_BOUNCE;
+	PhysicsBackend physicsBackend = PHYSICS_BACKEND_BULLET;
+	GravityMode gravityMode = GRAVITY_MODE_PAIRWISE;
 	double gravityVerticalForce = 100.0;
 	double gravityRadialForce = 0.15;
+	double barnesHutTheta = 0.5;
+	// Instruction set of the direct gravity kernel, lowered to the best one the CPU has,
+	// so the default always runs the fastest
+	gravitykernel::KernelType gravityKernel = gravitykernel::KERNEL_AVX2;
 	double springForce = 0.1;
 	double springDamping = 0;
 	double springDistance = 50;
 	double springMaxDistance = springDistance * 1.25;
 	double backgroundFrictionForce = 1;
 	double cubicPixelMass = 0.001;
+	// Balls use defaultMaterial and planes wallMaterial unless they are given another one
+	Material defaultMaterial;
+	Material wallMaterial;
 
 	double bumpSpeed = 1;
 	double gravityIncrement = 0.1;
 
 	int springMaxConnections = 1024;
+	// Lets bodies that stay slower than the thresholds for sleepDelay seconds sleep. Sleeping
+	// bodies cost the backend almost nothing. A sleeping body keeps the force it fell asleep
+	// under, radial gravity and springs that differ from it and bumps add up their velocity
+	// change and wake the body once the sum reaches sleepLinearThreshold. Gravity on sleeping
+	// bodies is computed every SLEEPING_GRAVITY_INTERVAL substeps only.
+	bool sleepEnabled = false;
+	// Pixels per second, and radians per second for the spin of Bullet bodies
+	double sleepLinearThreshold = 5;
+	double sleepAngularThreshold = 1;
+	double sleepDelay = 2;
+	// Physics substep length, force constants stay tuned per SECONDS_PER_FRAME
+	double fixedTimeStep = SECONDS_PER_FRAME;
+	int maxSubSteps = 100;
+	// Wall clock seconds a frame may spend on substeps before the rest is dropped, 0 for no limit.
+	// Headless runs never drop for time.
+	double stepBudget = 0.012;
+	// Threads for the force pass, 0 uses every hardware thread
+	int threadCount = 0;
+	// Saved with F5 and loaded with F9
+	std::string snapshotFile = "snapshot.pbs";
+	// Trajectory recording is toggled with R
+	std::string recordFile = "trajectory.pbt";
+	bool recordOnStart = false;
+	// Quantization steps per pixel for positions and radii, and per pixel per second for velocities
+	double recordPrecision = 64;
+	int recordKeyframeInterval = 60;
+	// Per frame phase timings are streamed here as CSV, only in builds with PHYSBOX_PROFILING
+	std::string profileFile;
 
 	const double SIMULATION_SPEED_BASE = 4;
 	int simulationSpeedExponent = 0;
@@ -49,26 +145,46 @@ public:
 	int mousePrevX = 0, mousePrevY = 0;
 	double offsetX = 0, offsetY = 0;
 
+	// Only balls, created in ballPool
 	std::vector<SimObject*> objects;
 	std::vector<Plane*> planes;
+	ParticleStore particles;
 
-	Simulation(std::function<bool(Simulation*)> exitConditionFunction);
+	// Settings come from configFile, with an empty path they all keep their defaults and the run is headless
+	Simulation(std::function<bool(Simulation*)> exitConditionFunction, std::string configFile = "simulation_settings.cfg");
 	~Simulation();
 	double runSimulation();
 	void resetSimulation();
 	Ball* addBall(double x, double y, double radius, double speedX, double speedY, sf::Color color, bool isActive = true);
+	// Adds a whole batch with storage reserved once and a single broadphase insert,
+	// much faster than addBall for large scenes. Returns the index of the first new ball in objects.
+	int addBalls(const std::vector<BallParameters>& balls);
 	Plane* addPlane(Plane::PlaneSide side);
 	void deleteAllObjects();
 	void deleteObject(SimObject* object);
 	void generateSystem(double centerX, double centerY, double centerRadius, double moonRadius, int moonCount, double gap);
+	// Saves balls, springs, planes and simulation parameters, see snapshot.h
+	bool saveSnapshot(std::string path);
+	// Replaces the current scene, leaves it untouched if the file is missing or invalid
+	bool loadSnapshot(std::string path);
+#ifdef PHYSBOX_PROFILING
+	Profiler& getProfiler();
+#endif
 
 private:
 
-	btDynamicsWorld* dynamicsWorld;
+	PhysicsWorld* physicsWorld = nullptr;
+	StepScheduler stepScheduler;
+#ifdef PHYSBOX_PROFILING
+	Profiler profiler;
+#endif
+	ObjectPool<Ball> ballPool;
+	ShapeCache shapeCache;
 	double time = 0;
 	sf::Clock clock;
 	bool pause = true;
-	bool exitRequest = false;
+	// Set by the physics thread when running threaded
+	std::atomic<bool> exitRequest{false};
 	bool uiEnabled = true;
 	std::function<bool(Simulation*)> exitContidionFunction;
 	int fpsCount = 0;
@@ -93,31 +209,148 @@ private:
 	};
 	FontSize currentFontSize = FONT_SIZE_NORMAL;
 	sf::Color currentTextColor = sf::Color::Yellow;
+	sf::VertexArray ballVertices;
+	std::vector<int> ballVertexOffsets;
+	std::vector<sf::Vector2f> circlePoints[MAX_CIRCLE_SEGMENTS + 1];
+	sf::VertexArray springVertices;
+	std::vector<int> springVertexOffsets;
+	// Spring color by opacity, which falls linearly with length up to springMaxDistance
+	sf::Color springColors[256];
+	ThreadPool* threadPool = nullptr;
+	QuadTree gravityTree;
+	std::vector<double> gravityMass;
+	// Sleeping bodies only get gravity every this many substeps and reuse it in between
+	static const int SLEEPING_GRAVITY_INTERVAL = 8;
+	int gravitySubSteps = 0;
+	bool sleepingGravityDue = false;
+	SpatialGrid springGrid;
+	SpringGraph springGraph;
+	// New index of every object during deleteMarked, -1 for deleted ones
+	std::vector<int> remapIndex;
+	TrajectoryRecorder recorder;
+	// (from, to) object index pairs of all springs, collected for drawing and recording or read from a replay
+	std::vector<int> springEdges;
+	TrajectoryReader replayReader;
+	// Playback position in recorded frames, advances by simulationSpeed every displayed frame
+	double replayPosition = 0;
+	int replayFrame = -1;
+	// Frames skipped by the seek keys
+	static const int REPLAY_SEEK_FRAMES = 60;
+	std::vector<PhysicsWorld::BodyPair> touchingPairs;
+	// Union-find parent of every object, roots are the balls the rest of the group merges into
+	std::vector<int> mergeGroups;
+	// Everything drawing needs from one simulation state. The physics side fills
+	// and publishes frames, the window only ever reads a published one.
+	struct Frame {
+		std::vector<double> x, y;
+		std::vector<double> radius;
+		std::vector<sf::Color> color;
+		std::vector<int> springEdges;
+		double time = 0;
+		double springMaxDistance = 0;
+		bool pause = true;
+		bool collisionsEnabled = false;
+		bool gravityRadialEnabled = false;
+		bool gravityVerticalEnabled = false;
+		bool backgroundFrictionEnabled = false;
+		bool springsEnabled = false;
+		CollisionType collisionType = COLLISION_TYPE_BOUNCE;
+		GravityMode gravityMode = GRAVITY_MODE_PAIRWISE;
+		double simulationSpeed = 1;
+		int simulationSpeedExponent = 0;
+		double gravityRadialForce = 0;
+		double barnesHutTheta = 0;
+		double gravityVerticalForce = 0;
+		double restitution = 0;
+		// -1 when not recording
+		int recordedFrames = -1;
+		int stepsPerSecond = 0;
+		int subSteps = 0;
+		int droppedSubSteps = 0;
+		// -1 when sleeping is off
+		int sleepingObjects = -1;
+	};
+	TripleBuffer<Frame> frames;
+	// Input that changes the simulation, run by the physics thread between steps
+	CommandQueue commands;
+	std::thread physicsThread;
+	std::atomic<bool> physicsStopping{false};
+	// How long a paused physics thread sleeps when no commands come in
+	static const int PAUSED_WAIT_MS = 16;
+	int stepCount = 0;
+	int stepsPerSecond = 0;
+	sf::Clock stepClock;
+	// Draws balls and springs, a separate pool when physics has its own thread
+	ThreadPool* renderThreadPool = nullptr;
 
+	double runHeadless();
+	double runReplay();
+	double runThreaded();
+	void physicsLoop();
+	void stopPhysicsThread();
+	// Runs command on the physics thread, or right away if there is none
+	void post(std::function<void()> command);
+	void publishFrame();
+	void quit();
+	void processReplay();
+	void seekReplay(int frame);
 	void initSFML();
-	void initBullet();
+	void initPhysics();
 	bool loadMedia();
-	void loadConfig();
+	void loadConfig(std::string path);
 	void close();
 	void render();
-	void drawSprings();
-	void drawUIText();
-	void drawOption(std::string text, bool* option);
+	// Per ball setup shared by addBall and addBalls, leaves adding the body to the world to them
+	Ball* createBall(const BallParameters& parameters);
+	void initRenderTables();
+	int getCircleSegments(double radius);
+	void drawBalls(const Frame& frame);
+	void drawSprings(const Frame& frame);
+	void drawUIText(const Frame& frame);
+#ifdef PHYSBOX_PROFILING
+	void drawProfilerPanel();
+#endif
+	void drawOption(std::string text, bool option);
 	void drawInfo(std::string text);
-	void drawInfo(std::string text, double* parameter);
+	void drawInfo(std::string text, double parameter);
 	void drawBlank();
 	void handleEvents();
 	void handleKeyboard(sf::Event e);
+	void handleSimulationKey(sf::Keyboard::Key key);
+	void handleReplayKeyboard(sf::Event e);
 	void handleMouse(sf::Event e);
 	void processPhysics();
+	void processForces(double delta);
+	bool isMergeEnabled();
+	void processMerges();
+	int findMergeGroup(int object);
+	void readParticles();
+	void writeParticles();
 	void deleteMarked();
 	void processGravity();
+	void processGravityPairwise();
+	void processGravityBarnesHut();
+	void processGravityDirect();
+	// Connects objects that came within springDistance and sorts the springs, once per frame
+	void formSprings();
+	// Spring forces for one substep, needs formSprings() first
 	void processSprings();
+	void applyForces(double delta);
+	// Adds to the velocity of object i. A sleeping object sums the change instead and wakes
+	// once the sum is large enough, the sum itself is dropped then.
+	void addVelocity(int i, double deltaVelX, double deltaVelY);
+	bool isGravityTarget(int i);
+	void wakeAll();
 	void drawText(int x, int y, int snap, std::string str);
 	sf::Color getBoolColor(bool var);
 	void updateFpsCount();
+	void updateStepCount();
 	void changeSimulationSpeed(int change);
 	void nextCollisionType();
+	void nextGravityMode();
+	void toggleRecording();
+	void recordFrame();
+	void collectSpringEdges();
 	void checkExitCondition();
 	void bumpAll(double velX, double velY);
 
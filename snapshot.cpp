@@ -0,0 +1,30 @@
+#include "snapshot.h"
+
+namespace {
+
+	size_t alignOffset(size_t offset) {
+		return (offset + 7) / 8 * 8;
+	}
+
+}
+
+snapshot::Layout snapshot::getLayout(const Header& header) {
+	size_t count = header.objectCount;
+	Layout layout;
+	layout.x = alignOffset(sizeof(Header));
+	layout.y = layout.x + count * sizeof(double);
+	layout.velX = layout.y + count * sizeof(double);
+	layout.velY = layout.velX + count * sizeof(double);
+	layout.mass = layout.velY + count * sizeof(double);
+	layout.radius = layout.mass + count * sizeof(double);
+	layout.angVel = layout.radius + count * sizeof(double);
+	layout.rotation = layout.angVel + count * 3 * sizeof(double);
+	layout.deactivationTime = layout.rotation + count * 4 * sizeof(double);
+	layout.color = layout.deactivationTime + count * sizeof(double);
+	layout.active = alignOffset(layout.color + count * 4);
+	layout.activation = layout.active + count;
+	layout.springs = alignOffset(layout.activation + count);
+	layout.planes = alignOffset(layout.springs + (size_t)header.springCount * 2 * sizeof(uint32_t));
+	layout.size = alignOffset(layout.planes + header.planeCount);
+	return layout;
+}
\ No newline at end of file
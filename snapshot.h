@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary layout of a saved world. The header is followed by one array per
+// field, each starting at a multiple of 8 bytes so a mapped file can be read
+// in place. Everything is stored in native byte order.
+// Bodies come back with their full motion and sleep state. Not stored are
+// the solver's warm-start data, contact manifolds and cached broadphase
+// pairs of either backend, which are rebuilt over the first substeps, and
+// spring rest lengths, every spring comes back at springDistance.
+namespace snapshot {
+
+	// "PBSS" read as a little-endian integer
+	const uint32_t MAGIC = 0x53534250;
+	const uint32_t VERSION = 2;
+
+	enum Flags {
+		FLAG_COLLISIONS = 1,
+		FLAG_GRAVITY_RADIAL = 2,
+		FLAG_GRAVITY_VERTICAL = 4,
+		FLAG_BACKGROUND_FRICTION = 8,
+		FLAG_SPRINGS = 16
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t objectCount;
+		// Spring connections, each stored as a (from, to) pair of object indices
+		uint32_t springCount;
+		uint32_t planeCount;
+		uint32_t flags;
+		int32_t collisionType;
+		int32_t gravityMode;
+		int32_t simulationSpeedExponent;
+		int32_t reserved;
+		double time;
+		double worldWidth, worldHeight;
+		double gravityVerticalForce, gravityRadialForce, barnesHutTheta;
+		double springForce, springDamping, springDistance, springMaxDistance;
+		double backgroundFrictionForce;
+		double restitution, friction;
+		double wallRestitution, wallFriction;
+	};
+
+	// Byte offsets of the arrays after the header
+	struct Layout {
+		size_t x, y, velX, velY;
+		// 0 for inactive balls
+		size_t mass;
+		size_t radius;
+		// Three doubles per object, x, y and z
+		size_t angVel;
+		// Orientation quaternion, four doubles per object, x, y, z and w
+		size_t rotation;
+		// Seconds the body has been under its sleeping thresholds
+		size_t deactivationTime;
+		// Four bytes per object, r, g, b and a
+		size_t color;
+		// One byte per object, 1 if the ball is active
+		size_t active;
+		// One byte per object, the Bullet activation state of the body
+		size_t activation;
+		size_t springs;
+		// One Plane::PlaneSide byte per plane
+		size_t planes;
+		size_t size;
+	};
+
+	Layout getLayout(const Header& header);
+
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include "spatialgrid.h"
+
+void SpatialGrid::build(const std::vector<double>& x, const std::vector<double>& y, double cellSize) {
+	this->cellSize = cellSize;
+	int count = (int)x.size();
+	int tableSize = 1;
+	while(tableSize < count * 2) {
+		tableSize <<= 1;
+	}
+	mask = tableSize - 1;
+	cellX.resize(count);
+	cellY.resize(count);
+	bodyBucket.resize(count);
+	bucketStart.assign(tableSize + 1, 0);
+	for(int i = 0; i < count; i++) {
+		cellX[i] = getCell(x[i]);
+		cellY[i] = getCell(y[i]);
+		bodyBucket[i] = getBucket(cellX[i], cellY[i]);
+		bucketStart[bodyBucket[i] + 1]++;
+	}
+	for(int i = 0; i < tableSize; i++) {
+		bucketStart[i + 1] += bucketStart[i];
+	}
+	bucketFill.assign(bucketStart.begin(), bucketStart.end() - 1);
+	sortedBodies.resize(count);
+	for(int i = 0; i < count; i++) {
+		sortedBodies[bucketFill[bodyBucket[i]]++] = i;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+
+// Uniform grid hashed into a table sized to the body count, so it needs no
+// world bounds. Bodies inside a cell are kept in index order, which keeps
+// neighbor iteration deterministic.
+class SpatialGrid {
+
+public:
+	void build(const std::vector<double>& x, const std::vector<double>& y, double cellSize);
+	// Calls callback(index) for every body in the 3x3 block of cells around (x, y),
+	// which covers every body closer than cellSize
+	template<typename F> void forEachNeighbor(double x, double y, F callback);
+
+private:
+	double cellSize = 1;
+	int mask = 0;
+	std::vector<int> cellX, cellY;
+	std::vector<int> bodyBucket;
+	std::vector<int> bucketStart;
+	std::vector<int> bucketFill;
+	std::vector<int> sortedBodies;
+
+	int getCell(double coord);
+	int getBucket(int cellX, int cellY);
+
+};
+
+template<typename F> void SpatialGrid::forEachNeighbor(double x, double y, F callback) {
+	if(sortedBodies.empty()) return;
+	int centerX = getCell(x);
+	int centerY = getCell(y);
+	for(int neighborY = centerY - 1; neighborY <= centerY + 1; neighborY++) {
+		for(int neighborX = centerX - 1; neighborX <= centerX + 1; neighborX++) {
+			int bucket = getBucket(neighborX, neighborY);
+			for(int i = bucketStart[bucket]; i < bucketStart[bucket + 1]; i++) {
+				int body = sortedBodies[i];
+				// Several cells can share a bucket, only visit the ones really in this cell
+				if(cellX[body] != neighborX || cellY[body] != neighborY) continue;
+				callback(body);
+			}
+		}
+	}
+}
+
+inline int SpatialGrid::getCell(double coord) {
+	return (int)std::floor(coord / cellSize);
+}
+
+inline int SpatialGrid::getBucket(int cellX, int cellY) {
+	return (int)(((unsigned)cellX * 73856093u) ^ ((unsigned)cellY * 19349663u)) & mask;
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "springgraph.h"
+#include <algorithm>
+#include <cmath>
+
+void SpringGraph::setObjectCount(int count) {
+	if(count == (int)outgoing.size()) return;
+	outgoing.resize(count, 0);
+	incoming.resize(count, 0);
+	// New objects have no springs, so the offsets just repeat the last one
+	offsets.resize(count + 1, offsets.empty() ? 0 : offsets.back());
+}
+
+int SpringGraph::size() {
+	return (int)from.size();
+}
+
+void SpringGraph::add(int from, int to, double restLength) {
+	this->from.push_back(from);
+	this->to.push_back(to);
+	this->restLength.push_back(restLength);
+	outgoing[from]++;
+	incoming[to]++;
+	sorted = false;
+}
+
+bool SpringGraph::contains(int from, int to) {
+	for(int edge = offsets[from]; edge < offsets[from + 1]; edge++) {
+		if(this->to[edge] == to) return true;
+	}
+	return false;
+}
+
+int SpringGraph::getOutgoingCount(int object) {
+	return outgoing[object];
+}
+
+int SpringGraph::getIncomingCount(int object) {
+	return incoming[object];
+}
+
+void SpringGraph::sort() {
+	forceX.resize(from.size());
+	forceY.resize(from.size());
+	broken.resize(from.size());
+	if(sorted) return;
+	// Counting sort by from object, the outgoing counts are the bucket sizes
+	int objectCount = (int)outgoing.size();
+	offsets.resize(objectCount + 1);
+	updateOffsets();
+	order.resize(from.size());
+	std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+	for(int edge = 0; edge < size(); edge++) {
+		order[fill[from[edge]]++] = edge;
+	}
+	std::vector<int> sortedTo(to.size());
+	std::vector<double> sortedRestLength(restLength.size());
+	std::vector<double> sortedForceX(forceX.size());
+	std::vector<double> sortedForceY(forceY.size());
+	for(int i = 0; i < size(); i++) {
+		sortedTo[i] = to[order[i]];
+		sortedRestLength[i] = restLength[order[i]];
+		sortedForceX[i] = forceX[order[i]];
+		sortedForceY[i] = forceY[order[i]];
+	}
+	for(int i = 0; i < objectCount; i++) {
+		std::fill(from.begin() + offsets[i], from.begin() + offsets[i + 1], i);
+	}
+	to.swap(sortedTo);
+	restLength.swap(sortedRestLength);
+	forceX.swap(sortedForceX);
+	forceY.swap(sortedForceY);
+	sorted = true;
+}
+
+int SpringGraph::getFirstEdge(int object) {
+	return offsets[object];
+}
+
+void SpringGraph::calculateForces(ParticleStore& store, int begin, int end,
+	double springForce, double springDamping, double springMaxDistance) {
+
+	const double* x = store.x.data();
+	const double* y = store.y.data();
+	const double* velX = store.velX.data();
+	const double* velY = store.velY.data();
+	const unsigned char* awake = store.awake.data();
+	const int* edgeFrom = from.data();
+	const int* edgeTo = to.data();
+	const double* edgeRestLength = restLength.data();
+	double* edgeForceX = forceX.data();
+	double* edgeForceY = forceY.data();
+	unsigned char* edgeBroken = broken.data();
+	double maxDistance = springMaxDistance > 0 ? springMaxDistance : INFINITY;
+	for(int edge = begin; edge < end; edge++) {
+		int i = edgeFrom[edge];
+		int j = edgeTo[edge];
+		// Neither end moved, so the force from the last pass still holds
+		if(!awake[i] && !awake[j]) continue;
+		double deltaX = x[j] - x[i];
+		double deltaY = y[j] - y[i];
+		double distance = sqrt(deltaX*deltaX + deltaY*deltaY);
+		double relativeSpeedX = velX[j] - velX[i];
+		double relativeSpeedY = velY[j] - velY[i];
+		double relativeSpeed = sqrt(relativeSpeedX*relativeSpeedX + relativeSpeedY*relativeSpeedY);
+		//TODO remake damping
+		double force = (distance - edgeRestLength[edge]) * springForce - relativeSpeed * springDamping;
+		bool isBroken = distance > maxDistance;
+		// Coincident objects and broken springs pull nothing
+		double scale = (distance > 0 && !isBroken) ? 1.0 : 0.0;
+		double invDistance = scale / (distance > 0 ? distance : 1.0);
+		edgeForceX[edge] = deltaX * invDistance * force + relativeSpeedX * springDamping * scale;
+		edgeForceY[edge] = deltaY * invDistance * force + relativeSpeedY * springDamping * scale;
+		edgeBroken[edge] = isBroken;
+	}
+}
+
+void SpringGraph::applyForces(ParticleStore& store, int begin, int end) {
+	for(int i = begin; i < end; i++) {
+		double sumX = 0;
+		double sumY = 0;
+		for(int edge = offsets[i]; edge < offsets[i + 1]; edge++) {
+			sumX += forceX[edge];
+			sumY += forceY[edge];
+		}
+		store.forceX[i] += sumX;
+		store.forceY[i] += sumY;
+	}
+}
+
+void SpringGraph::removeBroken() {
+	std::vector<unsigned char> keep(broken.size());
+	bool anyBroken = false;
+	for(int edge = 0; edge < size(); edge++) {
+		keep[edge] = !broken[edge];
+		anyBroken |= broken[edge] != 0;
+	}
+	if(anyBroken) {
+		compact(keep);
+	}
+}
+
+void SpringGraph::remap(const std::vector<int>& newIndex, int newCount) {
+	std::vector<unsigned char> keep(from.size());
+	for(int edge = 0; edge < size(); edge++) {
+		keep[edge] = newIndex[from[edge]] >= 0 && newIndex[to[edge]] >= 0;
+	}
+	compact(keep);
+	// Surviving objects keep their order, so sorted edges stay sorted
+	for(int edge = 0; edge < size(); edge++) {
+		from[edge] = newIndex[from[edge]];
+		to[edge] = newIndex[to[edge]];
+	}
+	outgoing.assign(newCount, 0);
+	incoming.assign(newCount, 0);
+	for(int edge = 0; edge < size(); edge++) {
+		outgoing[from[edge]]++;
+		incoming[to[edge]]++;
+	}
+	offsets.resize(newCount + 1);
+	if(sorted) {
+		updateOffsets();
+	}
+}
+
+void SpringGraph::clear() {
+	from.clear();
+	to.clear();
+	restLength.clear();
+	forceX.clear();
+	forceY.clear();
+	broken.clear();
+	offsets.assign(1, 0);
+	outgoing.clear();
+	incoming.clear();
+	sorted = true;
+}
+
+void SpringGraph::compact(const std::vector<unsigned char>& keep) {
+	forceX.resize(from.size());
+	forceY.resize(from.size());
+	int count = 0;
+	for(int edge = 0; edge < size(); edge++) {
+		if(!keep[edge]) {
+			outgoing[from[edge]]--;
+			incoming[to[edge]]--;
+			continue;
+		}
+		from[count] = from[edge];
+		to[count] = to[edge];
+		restLength[count] = restLength[edge];
+		forceX[count] = forceX[edge];
+		forceY[count] = forceY[edge];
+		count++;
+	}
+	from.resize(count);
+	to.resize(count);
+	restLength.resize(count);
+	forceX.resize(count);
+	forceY.resize(count);
+	broken.assign(count, 0);
+	if(sorted) {
+		// Still grouped by from object, only the group boundaries moved
+		updateOffsets();
+	}
+}
+
+void SpringGraph::updateOffsets() {
+	offsets[0] = 0;
+	for(int i = 0; i < (int)outgoing.size(); i++) {
+		offsets[i + 1] = offsets[i] + outgoing[i];
+	}
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include "particlestore.h"
+
+// Springs between objects as flat edge arrays indexed like the particle store.
+// A spring pulls only its from object, the usual pair of opposite springs pulls
+// both. After sort() edges are grouped by from object in CSR order, so the
+// springs of object i are edges getFirstEdge(i) to getFirstEdge(i + 1) - 1.
+class SpringGraph {
+
+public:
+	std::vector<int> from, to;
+	std::vector<double> restLength;
+	// Written by calculateForces: force on the from object and whether the spring broke.
+	// The forces move with their edges, so springs between sleeping objects keep them.
+	std::vector<double> forceX, forceY;
+	std::vector<unsigned char> broken;
+
+	// Grows or shrinks the per object counts, shrinking is only valid without springs to dropped objects
+	void setObjectCount(int count);
+	int size();
+	void add(int from, int to, double restLength);
+	// Only sees springs added before the last sort()
+	bool contains(int from, int to);
+	int getOutgoingCount(int object);
+	int getIncomingCount(int object);
+	// Stable, only reorders if a spring was added since the last call.
+	// Also sizes forceX, forceY and broken for calculateForces.
+	void sort();
+	int getFirstEdge(int object);
+	// Edge sweep over [begin, end) without shared writes, safe to split between threads.
+	// Skips springs whose objects both sleep.
+	void calculateForces(ParticleStore& store, int begin, int end,
+		double springForce, double springDamping, double springMaxDistance);
+	// Adds the forces of each object's springs to the store for objects [begin, end), needs sort()
+	void applyForces(ParticleStore& store, int begin, int end);
+	// Drops every spring calculateForces marked as broken in one pass, keeps the order
+	void removeBroken();
+	// newIndex holds the new index of every object or -1 if it was removed, springs of removed objects go too
+	void remap(const std::vector<int>& newIndex, int newCount);
+	void clear();
+
+private:
+	// CSR offsets by from object, objectCount + 1 entries once sorted
+	std::vector<int> offsets;
+	std::vector<int> outgoing, incoming;
+	bool sorted = true;
+	std::vector<int> order;
+
+	void compact(const std::vector<unsigned char>& keep);
+	void updateOffsets();
+
+};
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "stepscheduler.h"
+#include <algorithm>
+#include <chrono>
+
+double StepScheduler::advance(PhysicsWorld* world, double frameTime) {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	accumulator += frameTime;
+	double threshold = fixedTimeStep * (1 - STEP_TOLERANCE);
+	subSteps = 0;
+	while(accumulator >= threshold && subSteps < maxSubSteps) {
+		// At least one substep per frame even over budget, otherwise nothing would ever move
+		if(budget > 0 && subSteps > 0 && std::chrono::duration<double>(Clock::now() - start).count() >= budget) break;
+		// Exactly one fixed substep, the world's own accumulator stays empty
+		world->stepSimulation(fixedTimeStep, 1, fixedTimeStep);
+		accumulator = std::max(accumulator - fixedTimeStep, 0.0);
+		subSteps++;
+	}
+	droppedSubSteps = 0;
+	if(accumulator >= threshold) {
+		droppedSubSteps = (int)(accumulator / threshold);
+		accumulator = std::max(accumulator - droppedSubSteps * fixedTimeStep, 0.0);
+		totalDroppedSubSteps += droppedSubSteps;
+	}
+	return subSteps * fixedTimeStep;
+}
+
+void StepScheduler::reset() {
+	accumulator = 0;
+	subSteps = 0;
+	droppedSubSteps = 0;
+	totalDroppedSubSteps = 0;
+}
+
+int StepScheduler::getSubSteps() {
+	return subSteps;
+}
+
+int StepScheduler::getDroppedSubSteps() {
+	return droppedSubSteps;
+}
+
+long long StepScheduler::getTotalDroppedSubSteps() {
+	return totalDroppedSubSteps;
+}
\ No newline at end of file
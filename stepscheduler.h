@@ -0,0 +1,34 @@
+#pragma once
+
+#include "physicsworld.h"
+
+// Advances a world by fixed substeps out of an explicit time accumulator.
+// Substeps that do not fit maxSubSteps or the wall clock budget of a frame are
+// dropped instead of carried over, so a slow frame never makes the next one
+// slower. Dropped time is simply not simulated.
+class StepScheduler {
+
+public:
+	double fixedTimeStep = 1.0/60.0;
+	int maxSubSteps = 100;
+	// Wall clock seconds one advance() may spend stepping, 0 for no limit
+	double budget = 0;
+
+	// Steps world through frameTime of simulated time, returns the simulated time actually covered
+	double advance(PhysicsWorld* world, double frameTime);
+	// Forgets leftover time and counts, for a new world
+	void reset();
+	// Of the last advance()
+	int getSubSteps();
+	int getDroppedSubSteps();
+	long long getTotalDroppedSubSteps();
+
+private:
+	// Accumulated time that is a hair short of a whole substep still counts as one
+	static constexpr double STEP_TOLERANCE = 1e-9;
+	double accumulator = 0;
+	int subSteps = 0;
+	int droppedSubSteps = 0;
+	long long totalDroppedSubSteps = 0;
+
+};
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount) {
+	nextChunk = 0;
+	for(int i = 1; i < threadCount; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for(std::thread& worker: workers) {
+		worker.join();
+	}
+}
+
+int ThreadPool::getThreadCount() {
+	return (int)workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)>& task) {
+	if(count <= 0) return;
+	if(workers.empty() || count == 1) {
+		task(0, count);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		this->count = count;
+		chunkSize = std::max(1, count / (getThreadCount() * 8));
+		nextChunk = 0;
+		activeWorkers = (int)workers.size();
+		generation++;
+	}
+	workAvailable.notify_all();
+	runChunks();
+	std::unique_lock<std::mutex> lock(mutex);
+	workDone.wait(lock, [this] { return activeWorkers == 0; });
+}
+
+void ThreadPool::workerLoop() {
+	unsigned seenGeneration = 0;
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			workAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+			if(stopping) return;
+			seenGeneration = generation;
+		}
+		runChunks();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers--;
+			if(activeWorkers == 0) {
+				workDone.notify_one();
+			}
+		}
+	}
+}
+
+void ThreadPool::runChunks() {
+	int begin;
+	while((begin = nextChunk.fetch_add(chunkSize)) < count) {
+		(*task)(begin, std::min(count, begin + chunkSize));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in the work, so a pool of N threads starts N - 1 workers.
+class ThreadPool {
+
+public:
+	ThreadPool(int threadCount);
+	~ThreadPool();
+	int getThreadCount();
+	// Runs task(begin, end) over [0, count) split into small chunks. Every thread
+	// keeps claiming the next unclaimed chunk until none are left, so uneven
+	// chunks balance out between threads. Returns when all chunks are done.
+	void parallelFor(int count, const std::function<void(int, int)>& task);
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workDone;
+	const std::function<void(int, int)>* task = nullptr;
+	int count = 0;
+	int chunkSize = 1;
+	std::atomic<int> nextChunk;
+	int activeWorkers = 0;
+	unsigned generation = 0;
+	bool stopping = false;
+
+	void workerLoop();
+	void runChunks();
+
+};
\ No newline at end of file
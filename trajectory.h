@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Trajectory file layout. A FileHeader is followed by one chunk per recorded
+// frame, a FrameHeader and its payload, then by the frame index and a Footer
+// at the very end. The payload holds x, y, velX, velY, radius and color of
+// every body, one field after another, each quantized to an integer and
+// stored as a zigzag varint. Keyframes store the values themselves, other
+// frames the change from the previous frame, so any frame can be decoded
+// starting from the closest keyframe before it.
+// Spring edges follow as (from, to) pairs, from as the change from the
+// previous edge and to as the change from from. They are only stored when
+// they changed, frames without FRAME_SPRINGS reuse the previous edges.
+namespace trajectory {
+
+	// "PBTR" and "PBTI" read as little-endian integers
+	const uint32_t MAGIC = 0x52544250;
+	const uint32_t INDEX_MAGIC = 0x49544250;
+	const uint32_t VERSION = 1;
+
+	enum FrameFlags {
+		FRAME_KEYFRAME = 1,
+		FRAME_SPRINGS = 2
+	};
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		// Quantization steps per pixel and per pixel per second
+		double positionScale;
+		double velocityScale;
+		uint32_t keyframeInterval;
+		uint32_t reserved;
+	};
+
+	struct FrameHeader {
+		uint32_t payloadSize;
+		uint32_t bodyCount;
+		uint32_t springCount;
+		uint32_t flags;
+		double time;
+	};
+
+	struct IndexEntry {
+		// File offset of the frame header
+		uint64_t offset;
+		double time;
+		uint32_t flags;
+		uint32_t reserved;
+	};
+
+	struct Footer {
+		uint64_t indexOffset;
+		uint32_t frameCount;
+		uint32_t magic;
+	};
+
+	inline void writeVarint(std::vector<unsigned char>& out, int64_t value) {
+		uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+		while(zigzag >= 0x80) {
+			out.push_back((unsigned char)(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		out.push_back((unsigned char)zigzag);
+	}
+
+	// Returns false if the data ends in the middle of a value
+	inline bool readVarint(const unsigned char*& data, const unsigned char* end, int64_t& value) {
+		uint64_t zigzag = 0;
+		for(int shift = 0; shift < 64; shift += 7) {
+			if(data == end) return false;
+			unsigned char byte = *data++;
+			zigzag |= (uint64_t)(byte & 0x7f) << shift;
+			if(!(byte & 0x80)) {
+				value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+				return true;
+			}
+		}
+		return false;
+	}
+
+}
\ No newline at end of file
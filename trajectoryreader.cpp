@@ -0,0 +1,160 @@
+#include "trajectoryreader.h"
+#include <cstring>
+
+bool TrajectoryReader::open(std::string path) {
+	close();
+	if(!file.open(path)) return false;
+	const char* data = file.getData();
+	size_t size = file.getSize();
+	if(size < sizeof(header)) {
+		close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	bool valid = header.magic == trajectory::MAGIC && header.version == trajectory::VERSION;
+	valid = valid && header.positionScale > 0 && header.velocityScale > 0;
+	if(!valid) {
+		close();
+		return false;
+	}
+	trajectory::Footer footer;
+	bool indexed = false;
+	if(size >= sizeof(header) + sizeof(footer)) {
+		memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+		indexed = footer.magic == trajectory::INDEX_MAGIC &&
+			footer.indexOffset + (uint64_t)footer.frameCount * sizeof(trajectory::IndexEntry) + sizeof(footer) == size;
+	}
+	if(indexed) {
+		indexOffset = footer.indexOffset;
+		frameCount = (int)footer.frameCount;
+		index.resize(frameCount);
+		if(frameCount > 0) {
+			memcpy(index.data(), data + indexOffset, frameCount * sizeof(trajectory::IndexEntry));
+		}
+	} else if(!rebuildIndex()) {
+		close();
+		return false;
+	}
+	if(frameCount > 0 && !(index[0].flags & trajectory::FRAME_KEYFRAME)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool TrajectoryReader::rebuildIndex() {
+	// A recording that was never stopped has no index or footer. Every chunk starts with
+	// its FrameHeader, so walk them and keep the frames up to the first cut off one.
+	const char* data = file.getData();
+	uint64_t size = file.getSize();
+	uint64_t offset = sizeof(header);
+	uint32_t bodyCount = 0;
+	while(offset + sizeof(trajectory::FrameHeader) <= size) {
+		trajectory::FrameHeader frameHeader;
+		memcpy(&frameHeader, data + offset, sizeof(frameHeader));
+		uint64_t next = offset + sizeof(frameHeader) + frameHeader.payloadSize;
+		if(next > size) break;
+		// A partly written index after the last frame is not a chunk, none of it passes all of these
+		if(frameHeader.flags & ~(uint32_t)(trajectory::FRAME_KEYFRAME | trajectory::FRAME_SPRINGS)) break;
+		if((uint64_t)frameHeader.bodyCount * FIELDS > frameHeader.payloadSize) break;
+		if(!index.empty() && !(frameHeader.time >= index.back().time)) break;
+		if(!(frameHeader.flags & trajectory::FRAME_KEYFRAME) && frameHeader.bodyCount != bodyCount) break;
+		bodyCount = frameHeader.bodyCount;
+		trajectory::IndexEntry entry = {};
+		entry.offset = offset;
+		entry.time = frameHeader.time;
+		entry.flags = frameHeader.flags;
+		index.push_back(entry);
+		offset = next;
+	}
+	indexOffset = offset;
+	frameCount = (int)index.size();
+	return frameCount > 0;
+}
+
+void TrajectoryReader::close() {
+	file.close();
+	index.clear();
+	frameCount = 0;
+	currentFrame = -1;
+}
+
+int TrajectoryReader::getFrameCount() {
+	return frameCount;
+}
+
+double TrajectoryReader::getFrameTime(int frame) {
+	return index[frame].time;
+}
+
+bool TrajectoryReader::readFrame(int frame, ParticleStore& particles, std::vector<int>& springs) {
+	if(frame < 0 || frame >= frameCount) return false;
+	int keyframe = frame;
+	while(!(index[keyframe].flags & trajectory::FRAME_KEYFRAME)) {
+		keyframe--;
+	}
+	int first = currentFrame >= keyframe && currentFrame <= frame ? currentFrame + 1 : keyframe;
+	for(int i = first; i <= frame; i++) {
+		if(!decodeFrame(i)) {
+			currentFrame = -1;
+			return false;
+		}
+		currentFrame = i;
+	}
+	int count = (int)values[0].size();
+	particles.resize(count);
+	for(int i = 0; i < count; i++) {
+		particles.x[i] = values[0][i] / header.positionScale;
+		particles.y[i] = values[1][i] / header.positionScale;
+		particles.velX[i] = values[2][i] / header.velocityScale;
+		particles.velY[i] = values[3][i] / header.velocityScale;
+		particles.radius[i] = values[4][i] / header.positionScale;
+		particles.color[i] = sf::Color((sf::Uint32)values[5][i]);
+	}
+	springs = this->springs;
+	return true;
+}
+
+bool TrajectoryReader::decodeFrame(int frame) {
+	const char* data = file.getData();
+	uint64_t offset = index[frame].offset;
+	trajectory::FrameHeader frameHeader;
+	if(offset + sizeof(frameHeader) > indexOffset) return false;
+	memcpy(&frameHeader, data + offset, sizeof(frameHeader));
+	if(offset + sizeof(frameHeader) + frameHeader.payloadSize > indexOffset) return false;
+	const unsigned char* payload = (const unsigned char*)data + offset + sizeof(frameHeader);
+	const unsigned char* end = payload + frameHeader.payloadSize;
+	// Every value takes at least a byte, so counts the payload cannot hold are rejected before allocating
+	if((uint64_t)frameHeader.bodyCount * FIELDS > frameHeader.payloadSize) return false;
+	int count = (int)frameHeader.bodyCount;
+	bool keyframe = (frameHeader.flags & trajectory::FRAME_KEYFRAME) != 0;
+	for(int field = 0; field < FIELDS; field++) {
+		std::vector<int64_t>& fieldValues = values[field];
+		if(keyframe) {
+			fieldValues.resize(count);
+		} else if((int)fieldValues.size() != count) {
+			return false;
+		}
+		for(int i = 0; i < count; i++) {
+			int64_t value;
+			if(!trajectory::readVarint(payload, end, value)) return false;
+			fieldValues[i] = keyframe ? value : fieldValues[i] + value;
+		}
+	}
+	if(frameHeader.flags & trajectory::FRAME_SPRINGS) {
+		if((uint64_t)frameHeader.springCount * 2 > (uint64_t)(end - payload)) return false;
+		springs.resize(frameHeader.springCount * 2);
+		int64_t from = 0;
+		for(int i = 0; i < (int)frameHeader.springCount; i++) {
+			int64_t fromDelta, toDelta;
+			if(!trajectory::readVarint(payload, end, fromDelta)) return false;
+			if(!trajectory::readVarint(payload, end, toDelta)) return false;
+			from += fromDelta;
+			int64_t to = from + toDelta;
+			if(from < 0 || from >= count || to < 0 || to >= count) return false;
+			springs[i * 2] = (int)from;
+			springs[i * 2 + 1] = (int)to;
+		}
+	}
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "mappedfile.h"
+#include "particlestore.h"
+#include "trajectory.h"
+
+// Random access to a trajectory file, see trajectory.h. The file is memory
+// mapped and frames are decoded on demand. Recordings that were never stopped
+// open with the frames that made it to disk.
+class TrajectoryReader {
+
+public:
+	bool open(std::string path);
+	void close();
+	int getFrameCount();
+	double getFrameTime(int frame);
+	// Fills positions, velocities, radii and colors of particles, resized to the
+	// frame's body count, and springs with (from, to) index pairs. Moving forward
+	// decodes only the frames in between, anything else starts from the closest
+	// keyframe before the frame.
+	bool readFrame(int frame, ParticleStore& particles, std::vector<int>& springs);
+
+private:
+	static const int FIELDS = 6;
+	MappedFile file;
+	trajectory::FileHeader header;
+	// Copied out of the mapping, frame payloads leave it at an arbitrary alignment
+	std::vector<trajectory::IndexEntry> index;
+	int frameCount = 0;
+	// Frame the decoded values below belong to, -1 if none
+	int currentFrame = -1;
+	std::vector<int64_t> values[FIELDS];
+	std::vector<int> springs;
+	uint64_t indexOffset = 0;
+
+	// Fills index from the frame chunks for files without one, false if no whole frame is left
+	bool rebuildIndex();
+	bool decodeFrame(int frame);
+
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "trajectoryrecorder.h"
+#include <cmath>
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+	stop();
+}
+
+bool TrajectoryRecorder::start(std::string path, double positionScale, double velocityScale, int keyframeInterval) {
+	stop();
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if(!file) return false;
+	this->positionScale = positionScale;
+	this->velocityScale = velocityScale;
+	this->keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+	trajectory::FileHeader header = {};
+	header.magic = trajectory::MAGIC;
+	header.version = trajectory::VERSION;
+	header.positionScale = positionScale;
+	header.velocityScale = velocityScale;
+	header.keyframeInterval = this->keyframeInterval;
+	file.write((const char*)&header, sizeof(header));
+	offset = sizeof(header);
+	index.clear();
+	previousSprings.clear();
+	framesAdded = 0;
+	framesWritten = 0;
+	stopping = false;
+	recording = true;
+	writer = std::thread(&TrajectoryRecorder::writerLoop, this);
+	return true;
+}
+
+void TrajectoryRecorder::stop() {
+	if(!recording) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frameAdded.notify_one();
+	writer.join();
+	trajectory::Footer footer = {};
+	footer.indexOffset = offset;
+	footer.frameCount = (uint32_t)index.size();
+	footer.magic = trajectory::INDEX_MAGIC;
+	if(!index.empty()) {
+		file.write((const char*)index.data(), index.size() * sizeof(trajectory::IndexEntry));
+	}
+	file.write((const char*)&footer, sizeof(footer));
+	file.close();
+	recording = false;
+}
+
+bool TrajectoryRecorder::isRecording() {
+	return recording;
+}
+
+int TrajectoryRecorder::getFrameCount() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)framesAdded;
+}
+
+void TrajectoryRecorder::recordFrame(double time, ParticleStore& particles, const std::vector<int>& springs) {
+	if(!recording) return;
+	std::unique_lock<std::mutex> lock(mutex);
+	frameWritten.wait(lock, [this] { return framesAdded - framesWritten < RING_SIZE; });
+	Frame& frame = ring[framesAdded % RING_SIZE];
+	lock.unlock();
+	frame.time = time;
+	frame.x.assign(particles.x.begin(), particles.x.end());
+	frame.y.assign(particles.y.begin(), particles.y.end());
+	frame.velX.assign(particles.velX.begin(), particles.velX.end());
+	frame.velY.assign(particles.velY.begin(), particles.velY.end());
+	frame.radius.assign(particles.radius.begin(), particles.radius.end());
+	frame.color.resize(particles.color.size());
+	for(int i = 0; i < (int)frame.color.size(); i++) {
+		frame.color[i] = particles.color[i].toInteger();
+	}
+	frame.springs.assign(springs.begin(), springs.end());
+	lock.lock();
+	framesAdded++;
+	lock.unlock();
+	frameAdded.notify_one();
+}
+
+void TrajectoryRecorder::writerLoop() {
+	while(true) {
+		std::unique_lock<std::mutex> lock(mutex);
+		frameAdded.wait(lock, [this] { return stopping || framesWritten < framesAdded; });
+		if(framesWritten == framesAdded) return;
+		const Frame& frame = ring[framesWritten % RING_SIZE];
+		lock.unlock();
+		writeFrame(frame);
+		lock.lock();
+		framesWritten++;
+		lock.unlock();
+		frameWritten.notify_one();
+	}
+}
+
+void TrajectoryRecorder::writeFrame(const Frame& frame) {
+	int count = (int)frame.x.size();
+	bool keyframe = index.size() % keyframeInterval == 0 || (int)previous[0].size() != count;
+	quantize(frame.x, positionScale, current[0]);
+	quantize(frame.y, positionScale, current[1]);
+	quantize(frame.velX, velocityScale, current[2]);
+	quantize(frame.velY, velocityScale, current[3]);
+	quantize(frame.radius, positionScale, current[4]);
+	current[5].assign(frame.color.begin(), frame.color.end());
+	payload.clear();
+	for(int field = 0; field < FIELDS; field++) {
+		const std::vector<int64_t>& values = current[field];
+		if(keyframe) {
+			for(int i = 0; i < count; i++) {
+				trajectory::writeVarint(payload, values[i]);
+			}
+		} else {
+			// Most bodies move little between frames, so the changes fit in a byte or two
+			const std::vector<int64_t>& last = previous[field];
+			for(int i = 0; i < count; i++) {
+				trajectory::writeVarint(payload, values[i] - last[i]);
+			}
+		}
+		previous[field].swap(current[field]);
+	}
+	trajectory::FrameHeader header = {};
+	header.bodyCount = count;
+	header.springCount = (uint32_t)(frame.springs.size() / 2);
+	header.time = frame.time;
+	if(keyframe) header.flags |= trajectory::FRAME_KEYFRAME;
+	if(keyframe || frame.springs != previousSprings) {
+		header.flags |= trajectory::FRAME_SPRINGS;
+		int lastFrom = 0;
+		for(int i = 0; i < (int)frame.springs.size(); i += 2) {
+			trajectory::writeVarint(payload, frame.springs[i] - lastFrom);
+			trajectory::writeVarint(payload, frame.springs[i + 1] - frame.springs[i]);
+			lastFrom = frame.springs[i];
+		}
+		previousSprings = frame.springs;
+	}
+	header.payloadSize = (uint32_t)payload.size();
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)payload.data(), payload.size());
+	// Readers rebuild the index of a recording cut short, this bounds what a crash loses
+	if(keyframe) {
+		file.flush();
+	}
+	trajectory::IndexEntry entry = {};
+	entry.offset = offset;
+	entry.time = frame.time;
+	entry.flags = header.flags;
+	index.push_back(entry);
+	offset += sizeof(header) + payload.size();
+}
+
+void TrajectoryRecorder::quantize(const std::vector<double>& values, double scale, std::vector<int64_t>& result) {
+	result.resize(values.size());
+	for(int i = 0; i < (int)values.size(); i++) {
+		result[i] = std::llround(values[i] * scale);
+	}
+}
\ No newline at end of file
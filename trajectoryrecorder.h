@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "particlestore.h"
+#include "trajectory.h"
+
+// Records every frame of a run into a trajectory file, see trajectory.h.
+// The simulation thread only copies the frame into a ring buffer, a writer
+// thread quantizes, encodes and writes it.
+class TrajectoryRecorder {
+
+public:
+	~TrajectoryRecorder();
+	bool start(std::string path, double positionScale, double velocityScale, int keyframeInterval);
+	// Writes the remaining frames and the frame index
+	void stop();
+	bool isRecording();
+	int getFrameCount();
+	// springs holds (from, to) index pairs. Waits only when the writer is a whole ring behind.
+	void recordFrame(double time, ParticleStore& particles, const std::vector<int>& springs);
+
+private:
+	static const int RING_SIZE = 4;
+	static const int FIELDS = 6;
+	struct Frame {
+		double time;
+		std::vector<double> x, y;
+		std::vector<double> velX, velY;
+		std::vector<double> radius;
+		std::vector<uint32_t> color;
+		std::vector<int> springs;
+	};
+	Frame ring[RING_SIZE];
+	// Frames handed to the writer and frames it has finished, the ring holds the difference
+	long long framesAdded = 0;
+	long long framesWritten = 0;
+	bool recording = false;
+	bool stopping = false;
+	std::mutex mutex;
+	std::condition_variable frameAdded;
+	std::condition_variable frameWritten;
+	std::thread writer;
+	std::ofstream file;
+
+	// Only used by the writer thread
+	double positionScale = 1;
+	double velocityScale = 1;
+	int keyframeInterval = 1;
+	std::vector<int64_t> current[FIELDS];
+	std::vector<int64_t> previous[FIELDS];
+	std::vector<int> previousSprings;
+	std::vector<unsigned char> payload;
+	std::vector<trajectory::IndexEntry> index;
+	uint64_t offset = 0;
+
+	void writerLoop();
+	void writeFrame(const Frame& frame);
+	void quantize(const std::vector<double>& values, double scale, std::vector<int64_t>& result);
+
+};
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+
+// Hands the latest value from one producer thread to one consumer thread
+// without locks. The producer fills the write buffer and publishes it, the
+// consumer picks up the newest published one. Neither side ever waits, values
+// published faster than they are acquired are skipped.
+template<typename T> class TripleBuffer {
+
+public:
+	// Producer side
+	T& getWriteBuffer() { return buffers[writeIndex]; }
+	void publish() {
+		writeIndex = middle.exchange(writeIndex | FRESH) & INDEX_MASK;
+	}
+	// Consumer side, returns false if nothing was published since the last call
+	bool acquire() {
+		if(!(middle.load() & FRESH)) return false;
+		readIndex = middle.exchange(readIndex) & INDEX_MASK;
+		return true;
+	}
+	const T& getReadBuffer() const { return buffers[readIndex]; }
+
+private:
+	static const int INDEX_MASK = 3;
+	// Set in middle when it holds a buffer the consumer has not seen yet
+	static const int FRESH = 4;
+	T buffers[3];
+	int writeIndex = 0;
+	int readIndex = 1;
+	std::atomic<int> middle{2};
+
+};
\ No newline at end of file
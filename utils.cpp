@@ -17,6 +17,11 @@ namespace utils {
 		return dist(mt);
 	}
 
+	void seedRandom(unsigned int seed) {
+		mt.seed(seed);
+		dist.reset();
+	}
+
 	sf::Color randomColor() {
 		return { (unsigned char)(random()*256),
 				 (unsigned char)(random()*256),
@@ -9,6 +9,8 @@ namespace utils {
 	double randomBetween(double min, double max);
 	double nonLinearRandomBetween(double min, double max, std::function<double(double)> f);
 	double random();
+	// Makes every random value that follows repeat between runs
+	void seedRandom(unsigned int seed);
 	sf::Color randomColor();
 	sf::Color randomColorBetween(int min, int max);
 	sf::Color randomHSVColor(int S, int V);